@@ -68,23 +68,31 @@ namespace {
         return slideAttacks(s, occ, RDirections);
     }
 
+#if defined(USE_COMPACT)
+    // Compact entry holds the attacks packed along the empty-board attacks,
+    // rook has at most 14 and bishop at most 13 such squares.
+    using AttackEntry = uint16_t;
+#else
+    using AttackEntry = Bitboard;
+#endif
+
     // Max Bishop Table Size
     // 4 * 2^6 + 12 * 2^7 + 44 * 2^5 + 4 * 2^9
     // 4 *  64 + 12 * 128 + 44 *  32 + 4 * 512
     //     256 +     1536 +     1408 +    2048 = 5248
-    Bitboard BAttacks[0x1480];
+    AttackEntry BAttacks[0x1480];
 
     // Max Rook Table Size
     // 4 * 2^12 + 24 * 2^11 + 36 * 2^10
     // 4 * 4096 + 24 * 2048 + 36 * 1024
     //    16384 +     49152 +     36864 = 102400
-    Bitboard RAttacks[0x19000];
+    AttackEntry RAttacks[0x19000];
 
     /// Initialize all bishop and rook attacks at startup.
     /// Magic bitboards are used to look up attacks of sliding pieces.
     /// In particular, here we use the so called "fancy" approach.
     template<PieceType PT>
-    void initializeMagic(Bitboard attacks[], Magic magics[]) {
+    void initializeMagic(AttackEntry attacks[], Magic magics[]) {
 
 #if !defined(USE_PEXT)
         constexpr uint16_t MaxIndex{ 0x1000 };
@@ -123,6 +131,11 @@ namespace {
             // new Bitboard[1 << popCount(magic.mask)];
             magic.attacks = (s == SQ_A1) ? attacks : magics[s - 1].attacks + size;
 
+#if defined(USE_COMPACT)
+            magic.reach = slideAttacks<PT>(s, 0);
+            assert(popCount(magic.reach) <= 16);
+#endif
+
 #if !defined(USE_PEXT)
             uint8_t bits{
     #if defined(IS_64BIT)
@@ -143,6 +156,8 @@ namespace {
 #if !defined(USE_PEXT)
                 occupancy[size] = occ;
                 reference[size] = slideAttacks<PT>(s, occ);
+#elif defined(USE_COMPACT)
+                magic.attacks[PEXT(occ, magic.mask)] = AttackEntry(PEXT(slideAttacks<PT>(s, occ), magic.reach));
 #else
                 magic.attacks[PEXT(occ, magic.mask)] = slideAttacks<PT>(s, occ);
 #endif
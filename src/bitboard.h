@@ -24,10 +24,21 @@ struct Magic {
 
     // Return attacks
     Bitboard attacksBB(Bitboard occ) const noexcept {
+    #if defined(USE_COMPACT)
+        return PDEP(attacks[index(occ)], reach);
+    #else
         return attacks[index(occ)];
+    #endif
     }
 
+#if defined(USE_COMPACT)
+    // Attacks are stored packed along the empty-board attacks (reach)
+    // and deposited back with PDEP, so an entry needs only 16 bits
+    uint16_t *attacks;
+    Bitboard  reach;
+#else
     Bitboard *attacks;
+#endif
     Bitboard  mask;
 
 #if !defined(USE_PEXT)
@@ -0,0 +1,232 @@
+#include "asyncstreambuffer.h"
+
+#include <cstring> // For memchr()
+#include <algorithm>
+#include <utility>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+    /// multipv() returns the multipv index of an "info depth" line, zero for any other line.
+    /// The line prefix is returned in prefix.
+    uint32_t multipv(std::string_view line, std::string_view &prefix) noexcept {
+        auto pos{ line.find("info depth ") };
+        if (pos == std::string_view::npos
+         || (pos != 0 && line.compare(0, 8, "session ") != 0)) {
+            return 0;
+        }
+        prefix = line.substr(0, pos);
+        pos = line.find(" multipv ", pos);
+        if (pos == std::string_view::npos) {
+            return 0;
+        }
+        uint32_t index{ 0 };
+        for (pos += 9; pos < line.size() && '0' <= line[pos] && line[pos] <= '9'; ++pos) {
+            index = index * 10 + (line[pos] - '0');
+        }
+        return index;
+    }
+}
+
+AsyncStreamBuffer::AsyncStreamBuffer(std::ostream &os) :
+    ostream{ os },
+    lineStart{ true },
+    head{ nullptr },
+    pushCount{ 0 },
+    writeCount{ 0 },
+    running{ false },
+    stopping{ false } {
+}
+
+AsyncStreamBuffer::~AsyncStreamBuffer() {
+    stop();
+}
+
+/// AsyncStreamBuffer::start() starts the writer thread.
+void AsyncStreamBuffer::start() {
+    if (running) {
+        return;
+    }
+    stopping = false;
+    thread = std::thread{ &AsyncStreamBuffer::idleFunc, this };
+    running = true;
+}
+
+/// AsyncStreamBuffer::stop() writes everything pending and stops the writer thread,
+/// the later output is written synchronously.
+void AsyncStreamBuffer::stop() {
+    publish(pending.size());
+    if (!running) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    pushCondVar.notify_one();
+    thread.join();
+    running = false;
+    // Lines pushed while the thread was finishing
+    flush();
+}
+
+/// AsyncStreamBuffer::drain() waits until everything written so far has reached the target stream.
+void AsyncStreamBuffer::drain() {
+    publish(pending.size());
+
+    std::unique_lock<std::mutex> lock(mutex);
+    writeCondVar.wait(lock, [&]() { return writeCount == pushCount.load(std::memory_order::memory_order_acquire); });
+}
+
+/// AsyncStreamBuffer::prefix() sets the prefix of the lines written from now on.
+void AsyncStreamBuffer::prefix(std::string_view prefixStr) noexcept {
+    linePrefix = prefixStr;
+}
+
+int AsyncStreamBuffer::sync() {
+    publish(pending.size());
+    return 0;
+}
+
+AsyncStreamBuffer::int_type AsyncStreamBuffer::overflow(int_type ch) {
+    if (ch == traits_type::eof()) {
+        return traits_type::not_eof(ch);
+    }
+    char const c{ char(ch) };
+    append(&c, 1);
+    if (c == '\n') {
+        publish(pending.size());
+    }
+    return ch;
+}
+
+std::streamsize AsyncStreamBuffer::xsputn(char const *s, std::streamsize n) {
+    append(s, size_t(n));
+    auto const pos{ pending.rfind('\n') };
+    if (pos != std::string::npos) {
+        publish(pos + 1);
+    }
+    return n;
+}
+
+/// AsyncStreamBuffer::append() appends to pending, prefixing every new line.
+void AsyncStreamBuffer::append(char const *s, size_t n) {
+    while (n != 0) {
+        if (lineStart) {
+            pending += linePrefix;
+            lineStart = false;
+        }
+        auto const *eol{ static_cast<char const*>(std::memchr(s, '\n', n)) };
+        size_t const count{ eol != nullptr ? size_t(eol - s) + 1 : n };
+        pending.append(s, count);
+        s += count;
+        n -= count;
+        lineStart = eol != nullptr;
+    }
+}
+
+/// AsyncStreamBuffer::publish() pushes the first count characters of pending on the queue.
+void AsyncStreamBuffer::publish(size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    auto *node{ new Node{ pending.substr(0, count), head.load(std::memory_order::memory_order_relaxed) } };
+    pending.erase(0, count);
+    pushCount.fetch_add(1, std::memory_order::memory_order_release);
+    while (!head.compare_exchange_weak(node->next, node, std::memory_order::memory_order_release, std::memory_order::memory_order_relaxed)) {}
+
+    if (!running) {
+        flush();
+        return;
+    }
+    // Taking the mutex orders the push before the writer's check, so the wake up is never lost
+    { std::lock_guard<std::mutex> lock(mutex); }
+    pushCondVar.notify_one();
+}
+
+/// AsyncStreamBuffer::write() writes a batch in order, skipping the superseded info lines.
+void AsyncStreamBuffer::write(Node *node) {
+
+    std::vector<std::string_view> lines;
+    for (auto *n = node; n != nullptr; n = n->next) {
+        std::string_view text{ n->text };
+        while (!text.empty()) {
+            auto const pos{ std::min(text.find('\n'), text.size()) };
+            lines.push_back(text.substr(0, pos));
+            text.remove_prefix(std::min(pos + 1, text.size()));
+        }
+    }
+
+    // Walk backward, a non-info line starts a new group
+    std::vector<bool> keep(lines.size(), true);
+    std::vector<std::pair<std::string_view, uint32_t>> seen;
+    for (size_t i = lines.size(); i-- > 0; ) {
+        std::string_view prefix;
+        auto const index{ multipv(lines[i], prefix) };
+        if (index == 0) {
+            seen.clear();
+        }
+        else if (std::find(seen.begin(), seen.end(), std::make_pair(prefix, index)) != seen.end()) {
+            keep[i] = false;
+        }
+        else {
+            seen.emplace_back(prefix, index);
+        }
+    }
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (keep[i]) {
+            ostream.write(lines[i].data(), lines[i].size()).put('\n');
+        }
+    }
+    ostream.flush();
+
+    while (node != nullptr) {
+        auto *next{ node->next };
+        delete node;
+        node = next;
+    }
+}
+
+/// AsyncStreamBuffer::flush() writes the lines queued so far, returns false if there were none.
+bool AsyncStreamBuffer::flush() {
+    auto *node{ head.exchange(nullptr, std::memory_order::memory_order_acquire) };
+    if (node == nullptr) {
+        return false;
+    }
+
+    // The queue is LIFO, reverse it to keep the output order
+    uint64_t count{ 0 };
+    Node *list{ nullptr };
+    while (node != nullptr) {
+        auto *next{ node->next };
+        node->next = list;
+        list = node;
+        node = next;
+        ++count;
+    }
+    write(list);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        writeCount += count;
+    }
+    writeCondVar.notify_all();
+    return true;
+}
+
+void AsyncStreamBuffer::idleFunc() {
+
+    while (true) {
+        if (flush()) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        pushCondVar.wait(lock, [&]() { return stopping || head.load(std::memory_order::memory_order_relaxed) != nullptr; });
+        if (head.load(std::memory_order::memory_order_relaxed) == nullptr) {
+            return;
+        }
+    }
+}
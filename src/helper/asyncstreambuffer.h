@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// AsyncStreamBuffer
+// Writers only append into memory, every complete line is pushed on a lock-free queue.
+// A dedicated thread pops the queue in batches and writes them to the target stream,
+// so a writer never blocks on the console or on the log file tied to it.
+// Within a batch an "info depth" line is dropped when a later line of the same multipv supersedes it.
+// Every line starts with the current prefix, used to tag the output of a session.
+// Writers must serialize among themselves (sync_cout does it), the buffer itself only guards the queue.
+// The writer thread runs between start() and stop(), outside of them the lines are written synchronously,
+// so output during static initialization or destruction does not depend on the thread.
+class AsyncStreamBuffer :
+    public std::streambuf {
+
+public:
+
+    explicit AsyncStreamBuffer(std::ostream&);
+    ~AsyncStreamBuffer();
+
+    // Delete copy and move constructors and assign operators
+    AsyncStreamBuffer(AsyncStreamBuffer const&) = delete;
+    AsyncStreamBuffer(AsyncStreamBuffer&&) = delete;
+
+    AsyncStreamBuffer& operator=(AsyncStreamBuffer const&) = delete;
+    AsyncStreamBuffer& operator=(AsyncStreamBuffer&&) = delete;
+
+    void start();
+    void stop();
+
+    void drain();
+    void prefix(std::string_view) noexcept;
+
+protected:
+
+    int sync() override;
+    int_type overflow(int_type) override;
+    std::streamsize xsputn(char const*, std::streamsize) override;
+
+private:
+
+    struct Node {
+        std::string text;
+        Node *next;
+    };
+
+    void append(char const*, size_t);
+    void publish(size_t);
+    void write(Node*);
+    bool flush();
+    void idleFunc();
+
+    std::ostream &ostream;
+    std::string pending;
+    std::string linePrefix;
+    bool lineStart;
+
+    std::atomic<Node*> head;
+    std::atomic<uint64_t> pushCount;
+    uint64_t writeCount;
+    std::atomic<bool> running;
+    bool stopping;
+
+    std::mutex mutex;
+    std::condition_variable pushCondVar;
+    std::condition_variable writeCondVar;
+    std::thread thread;
+};
@@ -0,0 +1,25 @@
+#include "filehandler.h"
+
+#if defined(_WIN32)
+    #if !defined(NOMINMAX)
+        #define NOMINMAX // Disable macros min() and max()
+    #endif
+    #if !defined(WIN32_LEAN_AND_MEAN)
+        #define WIN32_LEAN_AND_MEAN // Excludes APIs such as Cryptography, DDE, RPC, Socket
+    #endif
+
+    #include <Windows.h>
+
+    #undef NOMINMAX
+    #undef WIN32_LEAN_AND_MEAN
+#else
+    #include <cstdio> // For std::rename()
+#endif
+
+bool replaceFile(std::string const &source, std::string const &target) noexcept {
+#if defined(_WIN32)
+    return MoveFileExA(source.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING|MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(source.c_str(), target.c_str()) == 0;
+#endif
+}
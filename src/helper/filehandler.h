@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// Replace the target file by the source file in one step, the target is never left missing.
+// POSIX rename() replaces atomically, Windows needs MoveFileEx() to replace an existing file.
+// Returns false (target untouched) if the source could not be moved.
+bool replaceFile(std::string const&, std::string const&) noexcept;
@@ -2,6 +2,9 @@
 
 #include <cstdint>
 
+// Cache line size, data written by one thread and read by others is kept on lines of its own
+constexpr size_t CacheLineSize{ 64 };
+
 void* allocAlignedStd(size_t, size_t) noexcept;
 void  freeAlignedStd(void*) noexcept;
 
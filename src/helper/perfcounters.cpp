@@ -0,0 +1,95 @@
+#include "perfcounters.h"
+
+#if defined(__linux__) && !defined(__ANDROID__)
+    #include <cstring> // For memset()
+    #include <linux/perf_event.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #define USE_PERF_EVENT
+#endif
+
+PerfCounters::PerfCounters() noexcept :
+    isOpened{ false } {
+    fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() {
+    close();
+}
+
+/// PerfCounters::open() opens the counters of the calling thread, an event the kernel refuses stays unavailable.
+void PerfCounters::open() noexcept {
+    if (isOpened) {
+        return;
+    }
+    isOpened = true;
+
+#if defined(USE_PERF_EVENT)
+    auto const cacheMiss{ [](uint64_t cache) {
+        return cache
+             | (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8)
+             | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+    } };
+
+    constexpr uint32_t Types[EVENTS]{
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE
+    };
+    uint64_t const configs[EVENTS]{
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        cacheMiss(PERF_COUNT_HW_CACHE_L1D),
+        PERF_COUNT_HW_CACHE_MISSES,
+        cacheMiss(PERF_COUNT_HW_CACHE_DTLB),
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+
+    for (uint8_t e = 0; e < EVENTS; ++e) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof (attr));
+        attr.size           = sizeof (attr);
+        attr.type           = Types[e];
+        attr.config         = configs[e];
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        attr.inherit        = 1;
+        attr.read_format    = PERF_FORMAT_TOTAL_TIME_ENABLED
+                            | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        // Members join the group of the cycles, on their own if it could not be opened
+        auto const groupFd{ e != CYCLES ? fds[CYCLES] : -1 };
+        fds[e] = int(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+#endif
+}
+
+void PerfCounters::close() noexcept {
+#if defined(USE_PERF_EVENT)
+    for (auto &fd : fds) {
+        if (fd != -1) {
+            ::close(fd);
+        }
+    }
+#endif
+    fds.fill(-1);
+    isOpened = false;
+}
+
+bool PerfCounters::available(Event e) const noexcept {
+    return fds[e] != -1;
+}
+
+/// PerfCounters::read() returns the raw counts so far with their times, zero for the unavailable events.
+PerfCounters::Counts PerfCounters::read() const noexcept {
+    Counts counts{};
+#if defined(USE_PERF_EVENT)
+    for (uint8_t e = 0; e < EVENTS; ++e) {
+        uint64_t data[3]; // value, time enabled, time running
+        if (fds[e] != -1
+         && ::read(fds[e], data, sizeof (data)) == sizeof (data)) {
+            counts[e] = { data[0], data[1], data[2] };
+        }
+    }
+#endif
+    return counts;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+/// PerfCounters reads the hardware counters of a thread through Linux perf_event_open(),
+/// counting the threads it starts later on too.
+/// The events are opened as one group led by the cycles, so they are counted over the same time.
+/// When the PMU has too few counters the kernel multiplexes them: each count comes with the time it was
+/// enabled and the time it was actually running, and is scaled up by their ratio.
+/// When the counters cannot be opened (other systems, containers, perf_event_paranoid)
+/// the events are unavailable and read as zero, so callers need no special case.
+class PerfCounters {
+
+public:
+
+    enum Event : uint8_t {
+        CYCLES,
+        INSTRUCTIONS,
+        L1D_MISSES,
+        LLC_MISSES,
+        DTLB_MISSES,
+        BRANCH_MISSES,
+        EVENTS
+    };
+
+    static constexpr char const *Names[EVENTS]{
+        "cycles", "instructions", "l1dMisses", "llcMisses", "dtlbMisses", "branchMisses"
+    };
+
+    /// Count of an event with its enabled and running times (ns)
+    struct Count {
+        uint64_t value;
+        uint64_t enabled;
+        uint64_t running;
+    };
+    using Counts = std::array<Count, EVENTS>;
+
+    /// scaled() estimates the count over the enabled time, zero if the event never ran
+    static double scaled(Count const &count) noexcept {
+        return count.running != 0 ? double(count.value) * count.enabled / count.running : 0.0;
+    }
+
+    PerfCounters() noexcept;
+    ~PerfCounters();
+
+    // Delete copy and move constructors and assign operators
+    PerfCounters(PerfCounters const&) = delete;
+    PerfCounters(PerfCounters&&) = delete;
+
+    PerfCounters& operator=(PerfCounters const&) = delete;
+    PerfCounters& operator=(PerfCounters&&) = delete;
+
+    void open() noexcept;
+    void close() noexcept;
+
+    bool opened() const noexcept {
+        return isOpened;
+    }
+    bool available(Event) const noexcept;
+    Counts read() const noexcept;
+
+private:
+
+    std::array<int, EVENTS> fds;
+    bool isOpened;
+};
@@ -8,6 +8,8 @@
 #include "polyglot.h"
 #include "psqtable.h"
 #include "searcher.h"
+#include "session.h"
+#include "syzygytb.h"
 #include "thread.h"
 #include "timemanager.h"
 #include "transposition.h"
@@ -17,6 +19,8 @@
 
 int main(int argc, char const *const argv[]) {
 
+    OutputBuffer.start();
+
     std::cout << Name << " " << engineInfo() << " by " << Author << '\n';
     std::cout << "info string Processor(s) detected " << std::thread::hardware_concurrency() << '\n';
 
@@ -31,13 +35,16 @@ int main(int argc, char const *const argv[]) {
     Cuckoos::initialize();
     EndGame::initialize();
     Book.initialize(Options["Book File"]);
-    Threadpool.setup(optionThreads());
+    MainSession.threadpool.setup(optionThreads());
     Evaluator::NNUE::initialize();
-    UCI::clear();
+    UCI::clear(MainSession);
 
     UCI::handleCommands(argc, argv);
 
-    Threadpool.setup(0);
+    MainSession.threadpool.setup(0);
+    // Stops the tablebase loader, the last one printing asynchronously
+    SyzygyTB::initialize("");
+    OutputBuffer.stop();
 
     //std::atexit(clear);
     return EXIT_SUCCESS;
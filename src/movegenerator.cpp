@@ -1,17 +1,26 @@
 #include "movegenerator.h"
 
+#include <cstring> // For memset()
+#include <atomic>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 #include "bitboard.h"
 #include "notation.h"
+#include "session.h"
+#include "thread.h"
+#include "uci.h"
+#include "helper/memoryhandler.h"
 
 namespace {
 
     /// Generates piece move
-    template<bool Checks>
-    void generatePieceMoves(ValMoves &moves, Position const &pos, Bitboard targets) {
+    /// Legal: pinned pieces move only along the ray from the king
+    template<bool Checks, bool Legal>
+    void generatePieceMoves(ValMoves &moves, Position const &pos, Bitboard targets, Bitboard pinneds) {
         auto const activeSide{ pos.activeSide() };
+        auto const fkSq{ pos.square(activeSide|KING) };
 
         for (PieceType pt = NIHT; pt <= QUEN; ++pt) {
             Square const *ps{ pos.squares(activeSide|pt) };
@@ -25,6 +34,10 @@ namespace {
                 if (Checks) {
                     attacks &= pos.checks(pt);
                 }
+                if (Legal
+                 && contains(pinneds, s)) {
+                    attacks &= lineBB(fkSq, s);
+                }
                 while (attacks != 0) { moves += makeMove<SIMPLE>(s, popLSq(attacks)); }
             }
         }
@@ -59,8 +72,9 @@ namespace {
         }
     }
     /// Generates pawn normal move
-    template<GenType GT, Color Own>
-    void generatePawnMoves(ValMoves &moves, Position const &pos, Bitboard targets) {
+    /// Legal: pinned pawns move only along the ray from the king, enpassant must not expose the king
+    template<GenType GT, Color Own, bool Legal>
+    void generatePawnMoves(ValMoves &moves, Position const &pos, Bitboard targets, Bitboard pinneds) {
         constexpr auto Opp{ ~Own };
         constexpr auto Push1{ PawnPush[Own] };
         constexpr auto Push2{ Push1 + Push1 };
@@ -75,13 +89,30 @@ namespace {
 
         Bitboard const pawns{ pos.pieces(Own, PAWN) };
 
+        // Pawns allowed to push, capture left and capture right
+        Bitboard pPawns{ pawns };
+        Bitboard lPawns{ pawns };
+        Bitboard rPawns{ pawns };
+        if (Legal) {
+            auto const fkSq{ pos.square(Own|KING) };
+            Bitboard pinnedPawns{ pawns & pinneds };
+            // Pinned pawns can push only on the king file
+            pPawns &= ~pinnedPawns | fileBB(fkSq);
+            while (pinnedPawns != 0) {
+                auto const org{ popLSq(pinnedPawns) };
+                Bitboard const pinRay{ lineBB(fkSq, org) };
+                if ((pawnLAttackBB<Own>(SquareBB[org]) & pinRay) == 0) { lPawns ^= org; }
+                if ((pawnRAttackBB<Own>(SquareBB[org]) & pinRay) == 0) { rPawns ^= org; }
+            }
+        }
+
         Bitboard const r7Pawns{ pawns &  Rank7 }; // Pawns on 7th Rank only
         Bitboard const rxPawns{ pawns & ~Rank7 }; // Pawns not on 7th Rank
 
         // Pawn single-push and double-push, no promotions
         if (GT != CAPTURE) {
 
-            Bitboard pushs1{ empties & pawnSglPushBB<Own>(rxPawns) };
+            Bitboard pushs1{ empties & pawnSglPushBB<Own>(rxPawns & pPawns) };
             Bitboard pushs2{ empties & pawnSglPushBB<Own>(pushs1 & Rank3) };
 
             if (GT == EVASION) {
@@ -116,13 +147,13 @@ namespace {
         if (r7Pawns != 0) {
             Bitboard b;
 
-            b = enemies & pawnLAttackBB<Own>(r7Pawns);
+            b = enemies & pawnLAttackBB<Own>(r7Pawns & lPawns);
             generatePromotionMoves<GT>(moves, pos, b, LAtt);
 
-            b = enemies & pawnRAttackBB<Own>(r7Pawns);
+            b = enemies & pawnRAttackBB<Own>(r7Pawns & rPawns);
             generatePromotionMoves<GT>(moves, pos, b, RAtt);
 
-            b = empties & pawnSglPushBB<Own>(r7Pawns);
+            b = empties & pawnSglPushBB<Own>(r7Pawns & pPawns);
             if (GT == EVASION) {
                 b &= targets;
             }
@@ -133,8 +164,8 @@ namespace {
         if (GT != QUIET
          && GT != QUIET_CHECK) {
 
-            Bitboard attacksL{ enemies & pawnLAttackBB<Own>(rxPawns) };
-            Bitboard attacksR{ enemies & pawnRAttackBB<Own>(rxPawns) };
+            Bitboard attacksL{ enemies & pawnLAttackBB<Own>(rxPawns & lPawns) };
+            Bitboard attacksR{ enemies & pawnRAttackBB<Own>(rxPawns & rPawns) };
             while (attacksL != 0) { auto const dst{ popLSq(attacksL) }; moves += makeMove<SIMPLE>(dst - LAtt, dst); }
             while (attacksR != 0) { auto const dst{ popLSq(attacksR) }; moves += makeMove<SIMPLE>(dst - RAtt, dst); }
 
@@ -150,7 +181,19 @@ namespace {
                     epPawns = 0;
                 }
                 assert(popCount(epPawns) <= 2);
-                while (epPawns != 0) { moves += makeMove<ENPASSANT>(popLSq(epPawns), epSq); }
+                while (epPawns != 0) {
+                    auto const org{ popLSq(epPawns) };
+                    if (Legal) {
+                        // Test the king for sliding attacks after removing both pawns
+                        auto const fkSq{ pos.square(Own|KING) };
+                        Bitboard const mocc{ (pos.pieces() ^ org ^ (epSq - Push1)) | epSq };
+                        if ((pos.pieces(Opp, BSHP, QUEN) & attacksBB<BSHP>(fkSq, mocc)) != 0
+                         || (pos.pieces(Opp, ROOK, QUEN) & attacksBB<ROOK>(fkSq, mocc)) != 0) {
+                            continue;
+                        }
+                    }
+                    moves += makeMove<ENPASSANT>(org, epSq);
+                }
             }
         }
     }
@@ -183,16 +226,16 @@ namespace {
     }
 
 
-    /// Generates all pseudo-legal moves of color for targets.
-    template<GenType GT>
-    void generateMoves(ValMoves &moves, Position const &pos, Bitboard targets) {
+    /// Generates all pseudo-legal (or legal) moves of color for targets.
+    template<GenType GT, bool Legal = false>
+    void generateMoves(ValMoves &moves, Position const &pos, Bitboard targets, Bitboard pinneds = 0) {
         constexpr bool Checks{ GT == QUIET_CHECK };
 
         pos.activeSide() == WHITE ?
-            generatePawnMoves<GT, WHITE>(moves, pos, targets) :
-            generatePawnMoves<GT, BLACK>(moves, pos, targets);
+            generatePawnMoves<GT, WHITE, Legal>(moves, pos, targets, pinneds) :
+            generatePawnMoves<GT, BLACK, Legal>(moves, pos, targets, pinneds);
 
-        generatePieceMoves<Checks>(moves, pos, targets);
+        generatePieceMoves<Checks, Legal>(moves, pos, targets, pinneds);
     }
 }
 
@@ -284,31 +327,61 @@ template<> void generate<QUIET_CHECK>(ValMoves &moves, Position const &pos) {
 }
 
 /// generate<LEGAL>       Generates all legal moves.
+/// Uses checkers, king blockers and pin rays so that no move needs a legality test afterwards.
 template<> void generate<LEGAL>(ValMoves &moves, Position const &pos) {
+    Bitboard const checkers{ pos.checkers() };
 
-    moves.reserve(64 - 48 * (pos.checkers() != 0));
-
-    pos.checkers() == 0 ?
-        generate<NORMAL>(moves, pos) :
-        generate<EVASION>(moves, pos);
+    moves.reserve(64 - 48 * (checkers != 0));
 
     auto const activeSide{ pos.activeSide() };
     auto const fkSq{ pos.square(activeSide|KING) };
+    Bitboard const pinneds{ pos.pieces(activeSide) & pos.kingBlockers(activeSide) };
+
+    // Double-check, only king move can save the day
+    if (!moreThanOne(checkers)) {
+        if (checkers == 0) {
+            generateMoves<NORMAL, true>(moves, pos, ~pos.pieces(activeSide), pinneds);
+        }
+        else {
+            // Generates blocking or captures of the checking piece
+            Bitboard const targets{ betweenBB(scanLSq(checkers), fkSq) | checkers };
+            generateMoves<EVASION, true>(moves, pos, targets, pinneds);
+        }
+    }
+
+    // King moves to non attacked squares, remove king so that sliding check x-rays the king
     Bitboard const mocc{ pos.pieces() ^ fkSq };
     Bitboard const enemies{ pos.pieces(~activeSide) };
-    Bitboard const pinneds{ pos.pieces( activeSide) & pos.kingBlockers(activeSide) };
-
-    // Filter illegal moves
-    moves.erase(std::remove_if(moves.begin(), moves.end(),
-                                [&](ValMove const &vm) {
-                                    return (mType(vm) == SIMPLE
-                                         && orgSq(vm) == fkSq
-                                         && (pos.attackersTo(dstSq(vm), mocc) & enemies) != 0)
-                                        || ((mType(vm) == CASTLE
-                                          || mType(vm) == ENPASSANT
-                                          || contains(pinneds, orgSq(vm)))
-                                         && !pos.legal(vm));
-                                }), moves.end());
+    Bitboard attacks{  attacksBB<KING>(fkSq)
+                    & ~attacksBB<KING>(pos.square(~activeSide|KING))
+                    & ~pos.pieces(activeSide) };
+    while (attacks != 0) {
+        auto const dst{ popLSq(attacks) };
+        if ((pos.attackersTo(dst, mocc) & enemies) == 0) {
+            moves += makeMove<SIMPLE>(fkSq, dst);
+        }
+    }
+
+    if (checkers == 0
+     && pos.canCastle(activeSide)) {
+        for (CastleSide const cs : { CS_KING, CS_QUEN }) {
+            auto const rookSq{ pos.castleRookSq(activeSide, cs) };
+            if (rookSq != SQ_NONE
+             && pos.castleExpeded(activeSide, cs)
+             && pos.canCastle(activeSide, cs)) {
+                // Check king's path for attackers
+                Bitboard const rocc{ pos.pieces() ^ rookSq };
+                Bitboard kingPath{ pos.castleKingPath(activeSide, cs) };
+                while (kingPath != 0
+                    && (pos.attackersTo(scanLSq(kingPath), rocc) & enemies) == 0) {
+                    kingPath &= kingPath - 1;
+                }
+                if (kingPath == 0) {
+                    moves += makeMove<CASTLE>(fkSq, rookSq);
+                }
+            }
+        }
+    }
 }
 
 void Perft::operator+=(Perft const &perft) noexcept {
@@ -399,8 +472,123 @@ void Perft::classify(Position &pos, Move m) {
     }
 }
 
+namespace {
+
+    /// PerftEntry stores the leaf count of a position at a depth.
+    /// Key is xor-ed with data, so a torn write by another thread is seen as a miss.
+    struct PerftEntry {
+        Key      key;
+        uint64_t data; // nodes << 8 | depth
+    };
+
+    /// PerftTable is a lock-less hash table keyed by (posiKey, depth) shared by the perft threads.
+    /// It lives for one perft only, sized as half of the hash and zeroed by the thread team.
+    class PerftTable {
+
+    public:
+
+        PerftTable(uint32_t mSize, uint16_t threadCount) noexcept :
+            entries{ nullptr },
+            entryCount{ 0 } {
+
+            if (mSize == 0) {
+                return;
+            }
+            entryCount = 1;
+            while (2 * entryCount * sizeof (PerftEntry) <= (size_t(mSize) << 20)) {
+                entryCount *= 2;
+            }
+            entries = static_cast<PerftEntry*>(allocAlignedLargePages(entryCount * sizeof (PerftEntry)));
+            if (entries == nullptr) {
+                entryCount = 0;
+                return;
+            }
+
+            std::vector<std::thread> threads;
+            for (uint16_t index = 0; index < threadCount; ++index) {
+                threads.emplace_back(
+                    [this, threadCount, index]() {
+
+                        if (threadCount > 8) {
+                            WinProcGroup::bind(index);
+                        }
+                        // Each thread will zero its part of the table
+                        auto const stride{ entryCount / threadCount };
+                        auto const start{ stride * index };
+                        auto const count{ index != threadCount - 1 ? stride : entryCount - start };
+                        std::memset(&entries[start], 0, count * sizeof (PerftEntry));
+                    });
+            }
+            for (auto &th : threads) {
+                th.join();
+            }
+        }
+        ~PerftTable() noexcept {
+            freeAlignedLargePages(entries);
+        }
+
+        PerftTable(PerftTable const&) = delete;
+        PerftTable& operator=(PerftTable const&) = delete;
+
+        bool probe(Key key, Depth depth, uint64_t &nodes) const noexcept {
+            if (entryCount == 0) {
+                return false;
+            }
+            auto const &pe{ entries[(key ^ depth) & (entryCount - 1)] };
+            auto const data{ pe.data };
+            if ((pe.key ^ data) == key
+             && (data & 0xFF) == uint64_t(depth)) {
+                nodes = data >> 8;
+                return true;
+            }
+            return false;
+        }
+
+        void save(Key key, Depth depth, uint64_t nodes) noexcept {
+            if (entryCount == 0) {
+                return;
+            }
+            auto &pe{ entries[(key ^ depth) & (entryCount - 1)] };
+            auto const data{ (nodes << 8) | uint64_t(depth) };
+            pe.key  = key ^ data;
+            pe.data = data;
+        }
+
+    private:
+
+        PerftEntry *entries;
+        size_t      entryCount;
+    };
+
+    /// perftCount() counts only the leaf nodes.
+    /// At depth 1 the legal moves are counted in bulk without making them.
+    uint64_t perftCount(PerftTable &perftTT, Position &pos, Depth depth) {
+        if (depth <= 1) {
+            return MoveList<LEGAL>(pos).size();
+        }
+
+        uint64_t nodes{ 0 };
+        if (perftTT.probe(pos.posiKey(), depth, nodes)) {
+            return nodes;
+        }
+
+        StateInfo si;
+        for (auto const &vm : MoveList<LEGAL>(pos)) {
+            pos.doMove(vm, si);
+            nodes += perftCount(perftTT, pos, depth - 1);
+            pos.undoMove(vm);
+        }
+
+        perftTT.save(pos.posiKey(), depth, nodes);
+        return nodes;
+    }
+
+}
+
 /// perft() is utility to verify move generation.
 /// All the leaf nodes up to the given depth are generated, and the accumulate is returned.
+/// At root the moves are split across the thread team, without detail
+/// the leaf nodes are only counted, using the perft hash table.
 template<bool RootNode>
 Perft perft(Position &pos, Depth depth, bool detail) {
     Perft sumLeaf;
@@ -422,41 +610,71 @@ Perft perft(Position &pos, Depth depth, bool detail) {
                 //<< std::setw(15) << "Stalemate"
                 ;
         }
-        std::cout << oss.str() << std::endl;
-    }
-    for (auto const &vm : MoveList<LEGAL>(pos)) {
-        Perft leaf;
-        if (RootNode
-         && depth <= 1) {
-            ++leaf.any;
-            if (detail) {
-                leaf.classify(pos, vm);
-            }
-        }
-        else {
-            StateInfo si;
-            pos.doMove(vm, si);
+        sync_cout << oss.str() << sync_endl;
 
-            if (depth <= 2) {
-                for (auto &ivm : MoveList<LEGAL>(pos)) {
-                    ++leaf.any;
-                    if (detail) {
-                        leaf.classify(pos, ivm);
-                    }
-                }
-            }
-            else {
-                leaf = perft<false>(pos, depth - 1, detail);
-            }
+        MoveList<LEGAL> const rootMoves{ pos };
+        std::vector<Perft> leafs(rootMoves.size());
 
-            pos.undoMove(vm);
+        auto const fen{ pos.fen() };
+        std::atomic<size_t> moveIndex{ 0 };
+
+        std::vector<std::thread> threads;
+        auto const &threadpool{ pos.thread()->session.threadpool };
+        auto const threadCount{ uint16_t(std::min(threadpool.size(), std::max(rootMoves.size(), size_t(1)))) };
+
+        // Only counting uses the table, freed when the perft returns
+        PerftTable perftTT{ detail || depth <= 2 ? 0U : uint32_t(Options["Hash"]), threadCount };
+        auto *const session{ CurrentSession };
+        for (uint16_t index = 0; index < threadCount; ++index) {
+            threads.emplace_back(
+                [&, threadCount, index]() {
+
+                    if (threadCount > 8) {
+                        WinProcGroup::bind(index);
+                    }
+                    CurrentSession = session;
+
+                    StateInfo rootSi;
+                    Position rootPos;
+                    rootPos.setup(fen, rootSi, threadpool[index]);
+
+                    size_t i;
+                    while ((i = moveIndex.fetch_add(1, std::memory_order::memory_order_relaxed)) < rootMoves.size()) {
+                        auto const &vm{ rootMoves[i] };
+                        auto &leaf{ leafs[i] };
+                        if (depth <= 1) {
+                            ++leaf.any;
+                            if (detail) {
+                                leaf.classify(rootPos, vm);
+                            }
+                        }
+                        else {
+                            StateInfo si;
+                            rootPos.doMove(vm, si);
+                            if (detail) {
+                                leaf = perft<false>(rootPos, depth - 1, detail);
+                            }
+                            else {
+                                leaf.any = perftCount(perftTT, rootPos, depth - 1);
+                            }
+                            rootPos.undoMove(vm);
+                        }
+                    }
+                });
+        }
+        for (auto &th : threads) {
+            th.join();
         }
-        sumLeaf += leaf;
+        threads.clear();
+
+        for (size_t i = 0; i < rootMoves.size(); ++i) {
+            auto const &vm{ rootMoves[i] };
+            auto const &leaf{ leafs[i] };
 
-        if (RootNode) {
+            sumLeaf += leaf;
             ++sumLeaf.num;
 
-            std::ostringstream oss;
+            oss.str("");
             oss << std::right << std::setfill('0') << std::setw( 2) << sumLeaf.num << " "
                 << std::left  << std::setfill(' ') << std::setw( 7) << //moveToCAN(vm)
                                                                        moveToSAN(vm, pos)
@@ -473,11 +691,10 @@ Perft perft(Position &pos, Depth depth, bool detail) {
                     //<< "   " << std::setw(12) << leaf.stalemate
                     ;
             }
-            std::cout << oss.str() << std::endl;
+            sync_cout << oss.str() << sync_endl;
         }
-    }
-    if (RootNode) {
-        std::ostringstream oss;
+
+        oss.str("");
         oss << '\n'
             << "Total Nodes:  " << std::right << std::setfill('.')
             << std::setw(18) << sumLeaf.any;
@@ -493,7 +710,23 @@ Perft perft(Position &pos, Depth depth, bool detail) {
                 //<< " " << std::setw(14) << sumLeaf.stalemate
                 ;
         }
-        std::cout << oss.str() << std::endl;
+        sync_cout << oss.str() << sync_endl;
+        return sumLeaf;
+    }
+
+    for (auto const &vm : MoveList<LEGAL>(pos)) {
+        if (depth <= 1) {
+            ++sumLeaf.any;
+            if (detail) {
+                sumLeaf.classify(pos, vm);
+            }
+        }
+        else {
+            StateInfo si;
+            pos.doMove(vm, si);
+            sumLeaf += perft<false>(pos, depth - 1, detail);
+            pos.undoMove(vm);
+        }
     }
     return sumLeaf;
 }
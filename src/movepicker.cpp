@@ -192,6 +192,17 @@ void MovePicker::value() {
     }
 }
 
+/// see() is SEE of the capture, the attackers of the target square are
+/// computed once and shared by all the captures landing there.
+bool MovePicker::see(Move m, Value thr) {
+    auto const dst{ dstSq(m) };
+    if (!contains(seeSquares, dst)) {
+        seeSquares |= dst;
+        seeAttackers[dst] = pos.attackersTo(dst);
+    }
+    return pos.see(m, thr, seeAttackers[dst]);
+}
+
 /// pick() returns the next move satisfying a predicate function
 template<typename Pred>
 bool MovePicker::pick(Pred filter) {
@@ -255,7 +266,7 @@ Move MovePicker::nextMove() {
 
     case NORMAL_GOOD_CAPTURES: {
         if (pick([&]() {
-                return pos.see(*vmBeg, Value(-69 * vmBeg->value / 1024)) ?
+                return see(*vmBeg, Value(-69 * vmBeg->value / 1024)) ?
                         // Put losing capture to badCaptureMoves to be tried later
                         true : (badCaptureMoves += *vmBeg, false);
             })) {
@@ -341,7 +352,7 @@ Move MovePicker::nextMove() {
         /* end */
 
     case PROBCUT_CAPTURE: {
-        return pick([&]() { return pos.see(*vmBeg, threshold); }) ?
+        return pick([&]() { return see(*vmBeg, threshold); }) ?
                 *vmBeg++ : MOVE_NONE;
     }
         /* end */
@@ -177,6 +177,8 @@ private:
     template<typename Pred>
     bool pick(Pred);
 
+    bool see(Move, Value);
+
     Position const &pos;
 
     ButterFlyStatsTable       const *butterFlyStats{ nullptr };
@@ -200,4 +202,8 @@ private:
           badCaptureMoves;
     Moves::iterator mBeg,
                     mEnd;
+
+    // Attackers of the capture target squares, computed once per square for SEE
+    Bitboard seeSquares{ 0 };
+    Bitboard seeAttackers[SQUARES];
 };
@@ -3,13 +3,17 @@
 
 #include "architecture.h"
 
+struct StateInfo;
+
 namespace Evaluator::NNUE {
 
     // Class that holds the result of affine transformation of input features
+    // It lives on the accumulator stack of the thread, owner is the state currently using it
     struct alignas(CacheLineSize) Accumulator {
 
         int16_t accumulation[2][RefreshTriggers.size()][TransformedFeatureDimensions];
         bool accumulationComputed;
+        StateInfo const *owner;
     };
 
 }
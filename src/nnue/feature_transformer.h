@@ -103,18 +103,18 @@ namespace Evaluator::NNUE {
         // Proceed with the difference calculation if possible
         bool updateAccumulatorIfPossible(Position const &pos) const {
             auto const *currState{ pos.state() };
-            if (currState->accumulator.accumulationComputed) {
+            if (currState->accumulated()) {
                 return true;
             }
             auto const *prevState{ currState->prevState };
             if (prevState != nullptr) {
-                if (prevState->accumulator.accumulationComputed) {
+                if (prevState->accumulated()) {
                     updateAccumulator(pos);
                     return true;
                 }
                 else
                 if (prevState->prevState != nullptr) {
-                    if (prevState->prevState->accumulator.accumulationComputed) {
+                    if (prevState->prevState->accumulated()) {
                         updateAccumulator(pos);
                         return true;
                     }
@@ -129,7 +129,7 @@ namespace Evaluator::NNUE {
             if (!updateAccumulatorIfPossible(pos)) {
                 refreshAccumulator(pos);
             }
-            auto const &accumulation = pos.state()->accumulator.accumulation;
+            auto const &accumulation = pos.state()->accumulator->accumulation;
 
         #if defined(USE_AVX2)
             constexpr IndexType NumChunks{ HalfDimensions / SimdWidth };
@@ -212,7 +212,7 @@ namespace Evaluator::NNUE {
     private:
         // Calculate cumulative value without using difference calculation
         void refreshAccumulator(Position const &pos) const {
-            auto &accumulator{ pos.state()->accumulator };
+            auto &accumulator{ *pos.state()->accumulator };
             IndexType i{ 0 };
             Features::IndexList activeIndices[2];
             RawFeatures::appendActiveIndices(pos, RefreshTriggers[i], activeIndices);
@@ -266,17 +266,17 @@ namespace Evaluator::NNUE {
 
             Accumulator *prevAccumulator;
             assert(pos.state()->prevState != nullptr);
-            if (pos.state()->prevState->accumulator.accumulationComputed) {
-                prevAccumulator = &pos.state()->prevState->accumulator;
+            if (pos.state()->prevState->accumulated()) {
+                prevAccumulator = pos.state()->prevState->accumulator;
             }
             else {
                 assert(pos.state()->prevState->prevState != nullptr
-                    && pos.state()->prevState->prevState->accumulator.accumulationComputed);
-                prevAccumulator = &pos.state()->prevState->prevState->accumulator;
+                    && pos.state()->prevState->prevState->accumulated());
+                prevAccumulator = pos.state()->prevState->prevState->accumulator;
             }
 
             
-            auto &accumulator{ pos.state()->accumulator };
+            auto &accumulator{ *pos.state()->accumulator };
             IndexType i{ 0 };
             Features::IndexList removedIndices[2], addedIndices[2];
             bool reset[2]{false, false};
@@ -81,7 +81,7 @@ namespace Evaluator::NNUE::Features {
                 }
             };
 
-            if (pos.state()->prevState->accumulator.accumulationComputed) {
+            if (pos.state()->prevState->accumulated()) {
                 const auto &prevMI = pos.state()->moveInfo;
                 if (prevMI.pieceCount == 0) return;
                 collectOne(prevMI);
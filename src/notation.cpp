@@ -281,12 +281,12 @@ Move moveOfSAN(std::string_view san, Position &pos) {
 /*
 /// Returns formated human-readable search information.
 std::string prettyInfo(Thread *th) {
-    uint64_t nodes{ Threadpool.accumulate(&Thread::nodes) };
+    uint64_t nodes{ th->session.threadpool.accumulate(&Thread::nodes) };
 
     std::ostringstream oss;
     oss << std::setw( 4) << th->finishedDepth
         << std::setw( 8) << prettyValue(th->rootMoves[0].newValue)
-        << std::setw(12) << prettyTime(TimeMgr.elapsed());
+        << std::setw(12) << prettyTime(th->session.timeMgr.elapsed());
 
          if (nodes < 10ULL*1000) {
         oss << std::setw(8) << uint16_t(nodes);
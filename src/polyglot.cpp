@@ -1,50 +1,57 @@
 #include "polyglot.h"
 
+#include <cstdio> // For std::remove()
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "movegenerator.h"
 #include "notation.h"
+#include "session.h"
+#include "thread.h"
+#include "uci.h"
+#include "zobrist.h"
+#include "helper/filehandler.h"
+#include "helper/memoryhandler.h"
 #include "helper/prng.h"
 #include "helper/string_view.h"
 
+#if defined(_WIN32)
+    #if !defined(NOMINMAX)
+        #define NOMINMAX // Disable macros min() and max()
+    #endif
+    #if !defined(WIN32_LEAN_AND_MEAN)
+        #define WIN32_LEAN_AND_MEAN // Excludes APIs such as Cryptography, DDE, RPC, Socket
+    #endif
+
+    #include <Windows.h>
+
+    #undef NOMINMAX
+    #undef WIN32_LEAN_AND_MEAN
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
 PolyBook Book;
 
 namespace {
 
+    /// Book fields are stored big-endian
     template<typename T>
-    std::ifstream& operator>>(std::ifstream &ifstream, T &t) {
-        t = T();
-        for (uint8_t idx = 0; idx < sizeof (T) && ifstream.good(); ++idx) {
-            t = T((t << 8) + uint8_t(ifstream.get()));
+    T readBigEndian(uint8_t const *data) noexcept {
+        T t{ 0 };
+        for (uint8_t idx = 0; idx < sizeof (T); ++idx) {
+            t = T((t << 8) + data[idx]);
         }
-        return ifstream;
-    }
-    //template<typename T>
-    //std::ofstream& operator<<(std::ofstream &ofstream, T const &t) {
-    //    for (uint8_t idx = 0; idx < sizeof (T) && ofstream.good(); ++idx) {
-    //        ofstream.put(uint8_t(t >> (8 * (sizeof (T) - 1 - idx))));
-    //    }
-    //    return ofstream;
-    //}
-
-    std::ifstream& operator>>(std::ifstream &ifstream, PolyEntry &pe) {
-        ifstream >> pe.key
-                 >> pe.move
-                 >> pe.weight
-                 >> pe.learn;
-        return ifstream;
-    }
-    //std::ofstream& operator<<(std::ofstream &ofstream, PolyEntry const &pe) {
-    //    ofstream << pe.key
-    //             << pe.move
-    //             << pe.weight
-    //             << pe.learn;
-    //    return ofstream;
-    //}
+        return t;
+    }
 
     // Converts polyglot move to engine move
     Move polyMove(Move m, Position const &pos) {
@@ -76,6 +83,13 @@ namespace {
         return MOVE_NONE;
     }
 
+    /// bookPath() normalizes the name of a book file
+    std::string bookPath(std::string_view bookFile) {
+        std::string filename{ bookFile };
+        std::replace(filename.begin(), filename.end(), '\\', '/');
+        return std::string{ trim(filename) };
+    }
+
     bool moveIsDraw(Position &pos, Move m) {
         StateInfo si;
         pos.doMove(m, si);
@@ -143,8 +157,15 @@ std::ostream& operator<<(std::ostream &ostream, PolyEntry const &pe) {
 
 constexpr PolyBook::PolyBook() noexcept :
     enabled{ false },
-    entry{ nullptr },
+    inUse{ false },
+    baseAddress{ nullptr },
+    mapping{ 0 },
+    entryData{ nullptr },
     entryCount{ 0 },
+    fileSize{ 0 },
+    fileTime{ 0 },
+    keyIndex{ nullptr },
+    keyIndexBits{ 0 },
     pieces{ 0 },
     failCount{ 0 } {
 }
@@ -156,44 +177,66 @@ PolyBook::~PolyBook() noexcept {
 void PolyBook::clear() noexcept {
 
     enabled = false;
-    if (entry != nullptr) {
-        delete[] entry;
-        entry = nullptr;
+    if (baseAddress != nullptr) {
+
+    #if defined(_WIN32)
+        UnmapViewOfFile(baseAddress);
+        CloseHandle((HANDLE)mapping);
+    #else
+        munmap(baseAddress, mapping);
+    #endif
+
+        baseAddress = nullptr;
+    }
+    mapping = 0;
+    entryData = nullptr;
+    entryCount = 0;
+    fileSize = 0;
+    fileTime = 0;
+
+    if (keyIndex != nullptr) {
+        delete[] keyIndex;
+        keyIndex = nullptr;
     }
+    keyIndexBits = 0;
 }
 
-int64_t PolyBook::findIndex(Key pgKey) const noexcept {
-    int64_t beg{ 0 };
-    int64_t end{ int64_t(entryCount) };
+/// PolyBook::key() decodes the key of the entry at index from the mapped book
+Key PolyBook::key(uint64_t idx) const noexcept {
+    return readBigEndian<uint64_t>(entryData + idx * sizeof (PolyEntry));
+}
+/// PolyBook::entry() decodes the entry at index from the mapped book
+PolyEntry PolyBook::entry(uint64_t idx) const noexcept {
+    auto const *data{ entryData + idx * sizeof (PolyEntry) };
+    PolyEntry pe;
+    pe.key    = readBigEndian<uint64_t>(data +  0);
+    pe.move   = readBigEndian<uint16_t>(data +  8);
+    pe.weight = readBigEndian<uint16_t>(data + 10);
+    pe.learn  = readBigEndian<uint32_t>(data + 12);
+    return pe;
+}
 
-    while (beg + 8 < end) {
-        int64_t mid{ (beg + end) / 2 };
+/// PolyBook::findIndex() returns the index of the first entry with the key, searching within [beg, end)
+int64_t PolyBook::findIndex(Key pgKey, uint64_t beg, uint64_t end) const noexcept {
 
-        if (pgKey > entry[mid].key) {
-            beg = mid;
+    while (beg < end) {
+        auto const mid{ beg + (end - beg) / 2 };
+        if (key(mid) < pgKey) {
+            beg = mid + 1;
         }
-        else
-        if (pgKey < entry[mid].key) {
+        else {
             end = mid;
         }
-        else { // pgKey == entry[mid].key
-            beg = std::max(mid - 4, int64_t(0));
-            end = std::min(mid + 4, int64_t(entryCount));
-        }
     }
-
-    while (beg < end) {
-        if (pgKey == entry[beg].key) {
-            while (beg > 0
-                && pgKey == entry[beg - 1].key) {
-                --beg;
-            }
-            return beg;
-        }
-        ++beg;
+    return beg < entryCount
+        && key(beg) == pgKey ? int64_t(beg) : -1;
+}
+int64_t PolyBook::findIndex(Key pgKey) const noexcept {
+    if (keyIndex != nullptr) {
+        auto const bucket{ pgKey >> (64 - keyIndexBits) };
+        return findIndex(pgKey, keyIndex[bucket], keyIndex[bucket + 1]);
     }
-
-    return -1;
+    return findIndex(pgKey, 0, entryCount);
 }
 //int64_t PolyBook::findIndex(Position const &pos) const noexcept {
 //    return findIndex(pos.pgKey());
@@ -221,41 +264,187 @@ void PolyBook::initialize(std::string_view bookFile) {
 
     clear();
 
-    std::string filename{ bookFile };
-    std::replace(filename.begin(), filename.end(), '\\', '/');
-    filename = trim(filename);
+    auto const filename{ bookPath(bookFile) };
     if (filename.empty()) {
         return;
     }
 
-    std::ifstream ifstream{ filename, std::ios::in|std::ios::binary };
-    if (!ifstream.is_open()) {
+#if defined(_WIN32)
+
+    HANDLE hFile = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) {
         return;
     }
 
-    ifstream.seekg(0, std::ios::end);
-    uint64_t const fileSize = ifstream.tellg();
-    ifstream.seekg(0, std::ios::beg);
+    DWORD hiSize;
+    DWORD const loSize = GetFileSize(hFile, &hiSize);
+    fileSize = (uint64_t(hiSize) << 32) | loSize;
+    if (fileSize < HeaderSize + sizeof (PolyEntry)) {
+        CloseHandle(hFile);
+        return;
+    }
+    FILETIME writeTime;
+    if (GetFileTime(hFile, nullptr, nullptr, &writeTime)) {
+        fileTime = (uint64_t(writeTime.dwHighDateTime) << 32) | writeTime.dwLowDateTime;
+    }
 
-    entryCount = (fileSize - HeaderSize) / sizeof (PolyEntry);
-    entry = new PolyEntry[entryCount];
-    if (entry == nullptr) {
+    HANDLE hFileMap = CreateFileMapping(hFile, nullptr, PAGE_READONLY, hiSize, loSize, nullptr);
+    CloseHandle(hFile);
+    if (hFileMap == nullptr) {
+        std::cerr << "CreateFileMapping() failed, file = " << filename << '\n';
+        return;
+    }
+
+    baseAddress = MapViewOfFile(hFileMap, FILE_MAP_READ, 0, 0, 0);
+    if (baseAddress == nullptr) {
+        std::cerr << "MapViewOfFile() failed, file = " << filename << '\n';
+        CloseHandle(hFileMap);
+        return;
+    }
+    mapping = (uint64_t)hFileMap;
+
+#else
+
+    int32_t hFile = ::open(filename.c_str(), O_RDONLY);
+    if (hFile == -1) {
         return;
     }
+
+    struct stat statbuf;
+    if (fstat(hFile, &statbuf) != 0
+     || uint64_t(statbuf.st_size) < HeaderSize + sizeof (PolyEntry)) {
+        ::close(hFile);
+        return;
+    }
+    fileSize = statbuf.st_size;
+    fileTime = uint64_t(statbuf.st_mtime) * 1000000000;
+    #if defined(__linux__)
+    fileTime += uint64_t(statbuf.st_mtim.tv_nsec);
+    #endif
+
+    void *address{ mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, hFile, 0) };
+    ::close(hFile);
+    if (address == MAP_FAILED) {
+        std::cerr << "mmap() failed, file = " << filename << '\n';
+        return;
+    }
+
+    #if defined(MADV_RANDOM)
+    madvise(address, fileSize, MADV_RANDOM);
+    #endif
+
+    baseAddress = address;
+    mapping = fileSize;
+
+#endif
+
+    entryData = static_cast<uint8_t const*>(baseAddress) + HeaderSize;
+    entryCount = (fileSize - HeaderSize) / sizeof (PolyEntry);
     enabled = true;
 
-    if (HeaderSize != 0) {
-        PolyEntry dummy;
-        for (uint64_t idx = 0; idx < HeaderSize / sizeof (PolyEntry); ++idx) {
-            ifstream >> dummy;
-        }
+    if (entryCount >= IndexMinEntries
+     && !loadIndex(filename + ".idx")) {
+        buildIndex();
+        saveIndex(filename + ".idx");
     }
+
+    sync_cout << "info string Book entries found " << entryCount << " from file \'" << filename << "\'" << sync_endl;
+}
+
+namespace {
+
+    constexpr uint64_t IndexMagic{ U64(0x3258444E494B4F42) }; // "BOKINDX2"
+
+    struct IndexHeader {
+        uint64_t magic;
+        uint64_t fileSize;
+        uint64_t fileTime;
+        uint64_t entryCount;
+        Key      firstKey;
+        Key      lastKey;
+        uint64_t bits;
+    };
+}
+
+/// PolyBook::buildIndex() scans the book keys once and fills the bucket boundaries.
+/// Polyglot keys are uniformly distributed so buckets hold about 16 entries each.
+void PolyBook::buildIndex() {
+
+    keyIndexBits = 1;
+    while (keyIndexBits < IndexMaxBits
+        && (entryCount >> (keyIndexBits + 4)) != 0) {
+        ++keyIndexBits;
+    }
+
+    uint64_t const bucketCount{ U64(1) << keyIndexBits };
+    keyIndex = new uint64_t[bucketCount + 1];
+
+    uint64_t bucket{ 0 };
     for (uint64_t idx = 0; idx < entryCount; ++idx) {
-        ifstream >> entry[idx];
+        auto const b{ key(idx) >> (64 - keyIndexBits) };
+        while (bucket <= b) {
+            keyIndex[bucket++] = idx;
+        }
+    }
+    while (bucket <= bucketCount) {
+        keyIndex[bucket++] = entryCount;
+    }
+}
+
+/// PolyBook::loadIndex() loads the sidecar index if it matches the mapped book,
+/// a book rewritten since the index was saved has another size or write time.
+/// An index with bounds out of order or past the book is refused, so that it is rebuilt.
+bool PolyBook::loadIndex(std::string const &indexFile) {
+
+    std::ifstream ifstream{ indexFile, std::ios::in|std::ios::binary };
+    if (!ifstream.is_open()) {
+        return false;
     }
-    ifstream.close();
 
-    std::cout << "info string Book entries found " << entryCount << " from file \'" << filename << "\'" << std::endl;
+    IndexHeader header;
+    ifstream.read((char*)(&header), sizeof (header));
+    if (!ifstream
+     || header.magic != IndexMagic
+     || header.fileSize != fileSize
+     || header.fileTime != fileTime
+     || header.entryCount != entryCount
+     || header.firstKey != key(0)
+     || header.lastKey != key(entryCount - 1)
+     || header.bits == 0
+     || header.bits > IndexMaxBits) {
+        return false;
+    }
+
+    uint64_t const bucketCount{ U64(1) << header.bits };
+    keyIndex = new uint64_t[bucketCount + 1];
+    ifstream.read((char*)(keyIndex), (bucketCount + 1) * sizeof (uint64_t));
+    // A damaged index could send the probes out of the book, the bounds have to run from 0 up to entryCount
+    bool valid{ ifstream
+             && keyIndex[0] == 0
+             && keyIndex[bucketCount] == entryCount };
+    for (uint64_t bucket = 0; valid && bucket < bucketCount; ++bucket) {
+        valid = keyIndex[bucket] <= keyIndex[bucket + 1];
+    }
+    if (!valid) {
+        delete[] keyIndex;
+        keyIndex = nullptr;
+        return false;
+    }
+    keyIndexBits = uint8_t(header.bits);
+    return true;
+}
+
+/// PolyBook::saveIndex() writes the index next to the book, failure only costs a rebuild next time
+void PolyBook::saveIndex(std::string const &indexFile) const {
+
+    std::ofstream ofstream{ indexFile, std::ios::out|std::ios::binary };
+    if (!ofstream.is_open()) {
+        return;
+    }
+
+    IndexHeader const header{ IndexMagic, fileSize, fileTime, entryCount, key(0), key(entryCount - 1), keyIndexBits };
+    ofstream.write((char const*)(&header), sizeof (header));
+    ofstream.write((char const*)(keyIndex), ((U64(1) << keyIndexBits) + 1) * sizeof (uint64_t));
 }
 
 /// PolyBook::probe() tries to find a book move for the given position.
@@ -267,7 +456,7 @@ Move PolyBook::probe(Position &pos, int16_t moveCount, bool pickBest) {
     static PRNG prng(now());
 
     if (!enabled
-     || entry == nullptr
+     || entryData == nullptr
      || (moveCount != 0
       && moveCount < pos.moveCount())
      || !canProbe(pos)) {
@@ -288,34 +477,34 @@ Move PolyBook::probe(Position &pos, int16_t moveCount, bool pickBest) {
     uint64_t pick1Index = index;
     uint64_t idx = index;
     while (idx < entryCount
-        && pgKey == entry[idx].key) {
+        && pgKey == key(idx)) {
 
-        if (entry[idx].move == MOVE_NONE) {
+        auto const pe{ entry(idx++) };
+        if (pe.move == MOVE_NONE) {
             continue;
         }
         ++count;
-        maxWeight = std::max(entry[idx].weight, maxWeight);
-        sumWeight += entry[idx].weight;
+        maxWeight = std::max(pe.weight, maxWeight);
+        sumWeight += pe.weight;
 
         // Choose the move
         if (pickBest) {
-            if (maxWeight == entry[idx].weight) {
-                pick1Index = idx;
+            if (maxWeight == pe.weight) {
+                pick1Index = idx - 1;
             }
         }
         else {
             // Move with a very high score, has a higher probability of being choosen.
             if (sumWeight != 0
-             && (prng.rand<uint32_t>() % sumWeight) < entry[idx].weight) {
-                pick1Index = idx;
+             && (prng.rand<uint32_t>() % sumWeight) < pe.weight) {
+                pick1Index = idx - 1;
             }
         }
-        ++idx;
     }
 
     Move move;
 
-    move = Move(entry[pick1Index].move);
+    move = Move(entry(pick1Index).move);
     if (move == MOVE_NONE) {
         return MOVE_NONE;
     }
@@ -339,7 +528,7 @@ Move PolyBook::probe(Position &pos, int16_t moveCount, bool pickBest) {
         assert(pick2Index < idx);
     }
 
-    move = Move(entry[pick2Index].move);
+    move = Move(entry(pick2Index).move);
     if (move == MOVE_NONE) {
         return MOVE_NONE;
     }
@@ -354,13 +543,13 @@ Move PolyBook::probe(Position &pos, int16_t moveCount, bool pickBest) {
 }
 
 std::string PolyBook::show(Position const &pos) const {
-    if (entry == nullptr
+    if (entryData == nullptr
      || !enabled) {
         return "Book entries empty.";
     }
 
-    auto const key{ pos.pgKey() };
-    auto index{ findIndex(key) };
+    auto const pgKey{ pos.pgKey() };
+    auto index{ findIndex(pgKey) };
     if (index < 0) {
         return "Book entries not found.";
     }
@@ -368,9 +557,9 @@ std::string PolyBook::show(Position const &pos) const {
     std::vector<PolyEntry> peSet;
     uint32_t sumWeight{ 0 };
     while (uint64_t(index) < entryCount
-        && key == entry[index].key) {
-        peSet.push_back(entry[index]);
-        sumWeight += entry[index].weight;
+        && pgKey == key(index)) {
+        peSet.push_back(entry(index));
+        sumWeight += peSet.back().weight;
         ++index;
     }
 
@@ -395,3 +584,448 @@ std::string PolyBook::show(Position const &pos) const {
     return oss.str();
 
 }
+
+/// PolyBook::benchmark() times random probes, half of them hitting the book,
+/// with the plain binary search and with the sparse index.
+std::string PolyBook::benchmark(uint32_t probeCount) const {
+    if (entryData == nullptr
+     || !enabled) {
+        return "Book entries empty.";
+    }
+
+    PRNG prng{ 0x1234 };
+    std::vector<Key> keys;
+    keys.reserve(probeCount);
+    for (uint32_t i = 0; i < probeCount; ++i) {
+        keys.push_back(i % 2 == 0 ?
+                        key(prng.rand<uint64_t>() % entryCount) :
+                        prng.rand<Key>());
+    }
+
+    int64_t found{ 0 };
+    auto startTime{ now() };
+    for (auto k : keys) {
+        found += findIndex(k, 0, entryCount) >= 0;
+    }
+    auto const binaryTime{ std::max(now() - startTime, TimePoint(1)) };
+
+    startTime = now();
+    for (auto k : keys) {
+        found -= findIndex(k) >= 0;
+    }
+    auto const indexTime{ std::max(now() - startTime, TimePoint(1)) };
+
+    std::ostringstream oss;
+    oss << "\nBook entries    : " << entryCount
+        << "\nIndex buckets   : " << (keyIndex != nullptr ? (U64(1) << keyIndexBits) : 0)
+        << "\nProbes          : " << probeCount
+        << std::fixed << std::setprecision(1)
+        << "\nBinary search   : " << 1.0e6 * binaryTime / probeCount << " ns/probe"
+        << "\nIndexed search  : " << 1.0e6 * indexTime / probeCount << " ns/probe";
+    if (found != 0) {
+        oss << "\nERROR: search mismatch " << found;
+    }
+    return oss.str();
+}
+
+namespace {
+
+    /// Book builder accumulates for each (position, move) the number of games
+    /// and the score from the mover's point of view (win 2, draw 1, loss 0).
+    struct BookMove {
+
+        bool operator==(BookMove const &bm) const noexcept {
+            return key == bm.key
+                && move == bm.move;
+        }
+
+        Key      key;
+        uint16_t move;
+    };
+
+    struct BookMoveHash {
+        size_t operator()(BookMove const &bm) const noexcept {
+            return size_t(bm.key ^ (bm.move * U64(0x9E3779B97F4A7C15)));
+        }
+    };
+
+    struct BookStat {
+        uint32_t games;
+        uint32_t score;
+    };
+
+    using BookMap = std::unordered_map<BookMove, BookStat, BookMoveHash>;
+
+    struct BookRecord {
+
+        bool operator<(BookRecord const &br) const noexcept {
+            return key != br.key ? key < br.key : move < br.move;
+        }
+
+        Key      key;
+        uint16_t move;
+        uint32_t games;
+        uint32_t score;
+    };
+
+    /// Converts engine move to polyglot move, castling is "king captures rook" in both
+    uint16_t toPolyMove(Move m) noexcept {
+        return uint16_t(mMask(m)
+                      | (mType(m) == PROMOTE ? (promoteType(m) - NIHT + 1) << 12 : 0));
+    }
+
+    /// Converts a PGN move token to a legal move, tolerating missing/extra check markers
+    Move pgnMove(std::string san, Position &pos) {
+        while (!san.empty()
+            && (san.back() == '!'
+             || san.back() == '?')) {
+            san.pop_back();
+        }
+        if (san == "0-0")   { san = "O-O"; }
+        else
+        if (san == "0-0-0") { san = "O-O-O"; }
+
+        auto m{ moveOfSAN(san, pos) };
+        if (m == MOVE_NONE
+         && !san.empty()) {
+            if (san.back() == '+'
+             || san.back() == '#') {
+                san.pop_back();
+                m = moveOfSAN(san, pos);
+            }
+            else {
+                m = moveOfSAN(san + "+", pos);
+                if (m == MOVE_NONE) {
+                    m = moveOfSAN(san + "#", pos);
+                }
+            }
+        }
+        return m;
+    }
+
+    /// Plays the movetext of one game and adds its first maxPly moves to the map.
+    /// Returns false if the game is skipped (unknown result or no move).
+    bool addGame(std::string const &fen, std::string_view result, std::string const &moveText,
+                 int16_t maxPly, Position &pos, BookMap &bookMap) {
+
+        Color winner;
+        bool draw{ false };
+             if (result == "1-0")     { winner = WHITE; }
+        else if (result == "0-1")     { winner = BLACK; }
+        else if (result == "1/2-1/2") { winner = COLORS; draw = true; }
+        else { return false; }
+
+        StateList states{ 1 };
+        pos.setup(fen, states.back(), pos.thread());
+
+        std::istringstream iss{ moveText };
+        std::string token;
+        int16_t ply{ 0 };
+        while (ply < maxPly
+            && (iss >> token)) {
+            if (token == "1-0"
+             || token == "0-1"
+             || token == "1/2-1/2"
+             || token == "*") {
+                break;
+            }
+            // Strip move number "12." or "12..."
+            auto const dot{ token.rfind('.') };
+            if (dot != std::string::npos) {
+                token.erase(0, dot + 1);
+            }
+            if (token.empty()
+             || token[0] == '$') {
+                continue;
+            }
+
+            auto const m{ pgnMove(token, pos) };
+            if (m == MOVE_NONE) {
+                break;
+            }
+            auto &bs{ bookMap[{ pos.pgKey(), toPolyMove(m) }] };
+            bs.games += 1;
+            bs.score += draw ? 1 : pos.activeSide() == winner ? 2 : 0;
+
+            states.emplace_back();
+            pos.doMove(m, states.back());
+            ++ply;
+        }
+        return ply != 0;
+    }
+
+    /// Parses the games of the PGN text
+    uint64_t parsePGN(std::string_view pgn, int16_t maxPly, Position &pos, BookMap &bookMap) {
+
+        uint64_t gameCount{ 0 };
+
+        std::string fen{ StartFEN };
+        std::string result;
+        std::string moveText;
+
+        auto const endGame{ [&]() {
+            if (!moveText.empty()) {
+                gameCount += addGame(fen, result, moveText, maxPly, pos, bookMap);
+            }
+            fen = StartFEN;
+            result.clear();
+            moveText.clear();
+        } };
+
+        int32_t depth{ 0 }; // Nesting level of comments and variations
+        size_t beg{ 0 };
+        while (beg < pgn.size()) {
+            auto end{ pgn.find('\n', beg) };
+            if (end == std::string_view::npos) {
+                end = pgn.size();
+            }
+            auto line{ pgn.substr(beg, end - beg) };
+            beg = end + 1;
+
+            if (depth == 0
+             && !line.empty()
+             && line[0] == '[') {
+                if (!moveText.empty()) {
+                    endGame();
+                }
+                // Tag pair: [Name "Value"]
+                auto const q1{ line.find('"') };
+                auto const q2{ line.rfind('"') };
+                if (q1 == std::string_view::npos
+                 || q2 <= q1) {
+                    continue;
+                }
+                auto const name{ line.substr(1, line.find(' ') - 1) };
+                auto const value{ line.substr(q1 + 1, q2 - q1 - 1) };
+                if (name == "FEN")    { fen = std::string{ value }; }
+                else
+                if (name == "Result") { result = value; }
+                continue;
+            }
+
+            // Movetext: drop comments, variations and rest-of-line comments
+            for (auto const ch : line) {
+                if (depth == 0
+                 && ch == ';') {
+                    break;
+                }
+                if (ch == '{' || ch == '(') { ++depth; moveText += ' '; continue; }
+                if (ch == '}' || ch == ')') { depth = std::max(depth - 1, 0); continue; }
+                if (depth == 0) {
+                    moveText += ch != '\r' ? ch : ' ';
+                }
+            }
+            moveText += ' ';
+        }
+        endGame();
+        return gameCount;
+    }
+
+    void writeBigEndian(char *data, uint64_t value, uint8_t size) noexcept {
+        for (uint8_t idx = 0; idx < size; ++idx) {
+            data[idx] = char(value >> (8 * (size - 1 - idx)));
+        }
+    }
+}
+
+/// makeBook() parses the PGN in parallel chunks (one per search thread), each thread
+/// collects its positions into its own hash map. The maps are then flattened,
+/// sorted in parallel and merged into a Polyglot book.
+/// Weight of a move is the sum of its scores, scaled down per position to fit 16 bits.
+void makeBook(ThreadPool const &threadpool, std::string_view pgnFile, std::string_view bookFile, int16_t maxPly, uint32_t minGames) {
+
+    auto const startTime{ now() };
+
+    std::string pgn;
+    {
+        std::ifstream ifstream{ std::string{ pgnFile }, std::ios::in|std::ios::binary };
+        if (!ifstream.is_open()) {
+            sync_cout << "info string PGN file \'" << pgnFile << "\' not found" << sync_endl;
+            return;
+        }
+        ifstream.seekg(0, std::ios::end);
+        pgn.resize(size_t(ifstream.tellg()));
+        ifstream.seekg(0, std::ios::beg);
+        ifstream.read(&pgn[0], pgn.size());
+    }
+
+    threadpool.mainThread()->waitIdle();
+    auto const threadCount{ uint16_t(threadpool.size()) };
+
+    // Split at game boundaries
+    std::vector<size_t> chunks{ 0 };
+    for (uint16_t index = 1; index < threadCount; ++index) {
+        auto boundary{ pgn.find("\n[Event ", std::max(pgn.size() * index / threadCount, chunks.back())) };
+        chunks.push_back(boundary != std::string::npos ? boundary + 1 : pgn.size());
+    }
+    chunks.push_back(pgn.size());
+
+    std::vector<BookMap> bookMaps(threadCount);
+    std::vector<uint64_t> gameCounts(threadCount, 0);
+    auto *const session{ CurrentSession };
+    std::vector<std::thread> threads;
+    for (uint16_t index = 0; index < threadCount; ++index) {
+        threads.emplace_back(
+            [&, threadCount, index]() {
+
+                if (threadCount > 8) {
+                    WinProcGroup::bind(index);
+                }
+                CurrentSession = session;
+                auto *const th{ threadpool[index] };
+                Position pos;
+                StateInfo si;
+                pos.setup(StartFEN, si, th);
+                gameCounts[index] = parsePGN(std::string_view{ pgn }.substr(chunks[index], chunks[index + 1] - chunks[index]),
+                                             maxPly, pos, bookMaps[index]);
+            });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    threads.clear();
+    pgn.clear();
+    pgn.shrink_to_fit();
+
+    uint64_t gameCount{ 0 };
+    std::vector<BookRecord> records;
+    {
+        size_t recordCount{ 0 };
+        for (auto const &bookMap : bookMaps) {
+            recordCount += bookMap.size();
+        }
+        records.reserve(recordCount);
+    }
+    for (uint16_t index = 0; index < threadCount; ++index) {
+        gameCount += gameCounts[index];
+        for (auto const &[bm, bs] : bookMaps[index]) {
+            records.push_back({ bm.key, bm.move, bs.games, bs.score });
+        }
+        BookMap{}.swap(bookMaps[index]);
+    }
+
+    // Parallel sort: sort the parts then merge them pairwise
+    std::vector<size_t> parts;
+    for (uint16_t index = 0; index <= threadCount; ++index) {
+        parts.push_back(records.size() * index / threadCount);
+    }
+    for (uint16_t index = 0; index < threadCount; ++index) {
+        threads.emplace_back(
+            [&, index]() {
+                std::sort(records.begin() + parts[index], records.begin() + parts[index + 1]);
+            });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    threads.clear();
+    for (uint16_t step = 1; step < threadCount; step *= 2) {
+        for (uint16_t index = 0; index + step < threadCount; index += 2 * step) {
+            threads.emplace_back(
+                [&, step, index]() {
+                    std::inplace_merge(records.begin() + parts[index],
+                                       records.begin() + parts[index + step],
+                                       records.begin() + parts[std::min(index + 2 * step, int32_t(threadCount))]);
+                });
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+        threads.clear();
+    }
+
+    // Combine the same (position, move) from different threads, filter and scale per position
+    std::vector<PolyEntry> entries;
+    std::vector<BookRecord> group;
+    auto const flushGroup{ [&]() {
+        uint32_t maxScore{ 0 };
+        for (auto const &br : group) {
+            maxScore = std::max(br.score, maxScore);
+        }
+        for (auto const &br : group) {
+            auto const weight{ maxScore > 0xFFFF ? uint64_t(br.score) * 0xFFFF / maxScore : br.score };
+            if (weight != 0) {
+                entries.push_back({ br.key, br.move, uint16_t(weight), 0 });
+            }
+        }
+        group.clear();
+    } };
+    for (size_t i = 0; i < records.size(); ) {
+        auto record{ records[i] };
+        while (++i < records.size()
+            && records[i].key == record.key
+            && records[i].move == record.move) {
+            record.games += records[i].games;
+            record.score += records[i].score;
+        }
+        if (!group.empty()
+         && group.back().key != record.key) {
+            flushGroup();
+        }
+        if (record.games >= minGames) {
+            group.push_back(record);
+        }
+    }
+    flushGroup();
+    records.clear();
+    records.shrink_to_fit();
+
+    // Polyglot orders moves of a position by weight, highest first
+    std::stable_sort(entries.begin(), entries.end(),
+        [](PolyEntry const &pe1, PolyEntry const &pe2) {
+            return pe1.key != pe2.key ? pe1.key < pe2.key : pe1.weight > pe2.weight;
+        });
+
+    // Written aside and renamed into place, the book may be the one mapped in use
+    auto const filename{ bookPath(bookFile) };
+    auto const tmpFile{ filename + ".tmp" };
+    std::ofstream ofstream{ tmpFile, std::ios::out|std::ios::binary };
+    if (!ofstream.is_open()) {
+        sync_cout << "info string Book file \'" << tmpFile << "\' cannot be created" << sync_endl;
+        return;
+    }
+    for (auto const &pe : entries) {
+        char data[sizeof (PolyEntry)];
+        writeBigEndian(data +  0, pe.key,    8);
+        writeBigEndian(data +  8, pe.move,   2);
+        writeBigEndian(data + 10, pe.weight, 2);
+        writeBigEndian(data + 12, pe.learn,  4);
+        ofstream.write(data, sizeof (data));
+    }
+    ofstream.close();
+    // A short write (disk full) must not replace the book
+    if (!ofstream) {
+        std::remove(tmpFile.c_str());
+        sync_cout << "info string Book file \'" << tmpFile << "\' cannot be written" << sync_endl;
+        return;
+    }
+
+    // Release the book in use before its file is replaced, then map the new one (or the old one again)
+    bool const inUse{ Book.enabled
+                   && bookPath(Options["Book File"]) == filename };
+    if (inUse) {
+        Book.initialize("");
+    }
+    bool const replaced{ replaceFile(tmpFile, filename) };
+    if (replaced) {
+        // Cached index of an older book with the same name is no longer valid
+        std::remove((filename + ".idx").c_str());
+    }
+    else {
+        std::remove(tmpFile.c_str());
+    }
+    if (inUse) {
+        Book.initialize(filename);
+    }
+    if (!replaced) {
+        sync_cout << "info string Book file \'" << filename << "\' cannot be replaced" << sync_endl;
+        return;
+    }
+
+    auto const elapsed{ std::max(now() - startTime, TimePoint(1)) };
+    sync_cout << "info string Book \'" << bookFile << "\' made"
+              << " games " << gameCount
+              << " entries " << entries.size()
+              << " time " << elapsed
+              << " gps " << gameCount * 1000 / elapsed << sync_endl;
+}
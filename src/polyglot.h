@@ -5,6 +5,8 @@
 #include "position.h"
 #include "type.h"
 
+class ThreadPool;
+
 /// Polyglot::Entry needs 16 bytes to be stored.
 ///  - Key       8 bytes
 ///  - Move      2 bytes
@@ -50,21 +52,47 @@ public:
 
     std::string show(Position const&) const;
 
+    std::string benchmark(uint32_t) const;
+
     static constexpr uint64_t HeaderSize{ 0 * sizeof (PolyEntry) };
+    // Books smaller than this are searched without the sparse index
+    static constexpr uint64_t IndexMinEntries{ 1 << 16 };
+    static constexpr uint8_t  IndexMaxBits{ 22 };
 
     bool enabled;
+    // Set by "Use Book", positions keep the Polyglot key incrementally only while in use
+    bool inUse;
 
 private:
     void clear() noexcept;
 
     int64_t findIndex(Key) const noexcept;
+    int64_t findIndex(Key, uint64_t, uint64_t) const noexcept;
     //int64_t findIndex(Position const&) const noexcept;
     //int64_t findIndex(std::string_view) const noexcept;
 
     bool canProbe(Position const&) noexcept;
 
-    PolyEntry *entry;
-    uint64_t   entryCount;
+    bool loadIndex(std::string const&);
+    void buildIndex();
+    void saveIndex(std::string const&) const;
+
+    Key       key(uint64_t) const noexcept;
+    PolyEntry entry(uint64_t) const noexcept;
+
+    // Book file is memory mapped read-only, entries are decoded on access
+    void          *baseAddress;
+    uint64_t       mapping;
+    uint8_t const *entryData;
+    uint64_t       entryCount;
+    // Size and last write time of the book file, to recognize a stale index
+    uint64_t       fileSize;
+    uint64_t       fileTime;
+
+    // Sparse index on the high bits of the key, bucket b holds entries [keyIndex[b], keyIndex[b+1])
+    // Cached next to the book file so only the first load has to scan the book.
+    uint64_t *keyIndex;
+    uint8_t   keyIndexBits;
 
     // Last probe info
     Bitboard pieces;
@@ -73,3 +101,6 @@ private:
 
 // Global Polyglot Book
 extern PolyBook Book;
+
+/// makeBook() builds a Polyglot book from the games of a PGN file, on the threads of the given pool
+extern void makeBook(ThreadPool const&, std::string_view, std::string_view, int16_t, uint32_t);
@@ -20,6 +20,14 @@
 
 namespace {
 
+    /// claimAccumulator() points the state to its slot on the accumulator stack.
+    /// A slot is reused along the plies, so its data is valid only for the owner state.
+    void claimAccumulator(StateInfo &si, Evaluator::NNUE::Accumulator *accumulators, int32_t slot) noexcept {
+        si.accumulator = &accumulators[slot & (Thread::AccumulatorSlots - 1)];
+        si.accumulator->owner = &si;
+        si.accumulator->accumulationComputed = false;
+    }
+
     /// Computes the non-pawn middle game material value for the given side.
     /// Material values are updated incrementally during the search.
     template<Color Own>
@@ -43,7 +51,9 @@ namespace {
 //void Position::initialize() {}
 
 Key Position::pgKey() const noexcept {
-    return PolyZob.computePosiKey(*this);
+    return _stateInfo->pgKey != 0 ?
+            _stateInfo->pgKey :
+            PolyZob.computePosiKey(*this);
 }
 /// Position::movePosiKey() computes the new hash key after the given moven, needed for speculative prefetch.
 /// It doesn't recognize special moves like castling, en-passant and promotions.
@@ -546,7 +556,10 @@ bool Position::canEnpassant(Color c, Square epSq, bool moved) const noexcept {
 /// Position::see() is Static Exchange Evaluator.
 /// Checks the SEE value of move is greater or equal to the given threshold.
 /// An algorithm similar to alpha-beta pruning with a null window is used.
-bool Position::see(Move m, Value threshold) const noexcept {
+/// The attackers of the destination square on the current occupancy can be given
+/// when already known (shared by all the captures to the square), then only
+/// the x-ray attackers behind the moving piece need to be added.
+bool Position::see(Move m, Value threshold, Bitboard dstAttackers) const noexcept {
     assert(isOk(m));
 
     // Only deal with normal moves, assume others pass a simple SEE
@@ -570,7 +583,21 @@ bool Position::see(Move m, Value threshold) const noexcept {
     int32_t res{ 1 };
     auto mov{ pColor(board[org]) };
     Bitboard mocc{ pieces() ^ org ^ dst };
-    Bitboard attackers{ attackersTo(dst, mocc) };
+    Bitboard attackers;
+    if (dstAttackers != 0) {
+        assert(dstAttackers == attackersTo(dst));
+        attackers = dstAttackers;
+        if (contains(PieceAttacksBB[BSHP][dst], org)) {
+            attackers |= (pieces(BSHP, QUEN) & attacksBB<BSHP>(dst, mocc));
+        }
+        else
+        if (contains(PieceAttacksBB[ROOK][dst], org)) {
+            attackers |= (pieces(ROOK, QUEN) & attacksBB<ROOK>(dst, mocc));
+        }
+    }
+    else {
+        attackers = attackersTo(dst, mocc);
+    }
     while (attackers != 0) {
         mov = ~mov;
         attackers &= mocc;
@@ -794,9 +821,39 @@ Position& Position::setup(std::string_view ff, StateInfo &si, Thread *th) {
     _stateInfo->matlKey = RandZob.computeMatlKey(*this);
     _stateInfo->pawnKey = RandZob.computePawnKey(*this);
     _stateInfo->posiKey = RandZob.computePosiKey(*this);
+    _stateInfo->pgKey = PolyZob.computePosiKey(*this);
     _stateInfo->checkers = attackersTo(square(active|KING)) & pieces(~active);
     setCheckInfo();
     _thread = th;
+    _accumulators = nullptr;
+
+    if (_thread != nullptr) {
+        accumulators(_thread->accumulators);
+    }
+
+    assert(ok());
+    return *this;
+}
+/// Position::accumulators() moves the position to the given accumulator stack, the current state takes its slot there.
+/// A position set up by the commands uses the stack of its session, so it never writes into the one of a searching thread.
+void Position::accumulators(Evaluator::NNUE::Accumulator *stack) noexcept {
+    _accumulators = stack;
+    claimAccumulator(*_stateInfo, _accumulators, 2 * ply);
+}
+/// Position::setup() initializes the position object as a copy of the given position,
+/// the state is copied too (so still linked to the previous states) but gets its own accumulator.
+Position& Position::setup(Position const &pos, StateInfo &si, Thread *th) {
+    std::memcpy(static_cast<void*>(this), &pos, sizeof (*this));
+
+    si = *pos._stateInfo;
+    si.accumulator = nullptr;
+    _stateInfo = &si;
+    _thread = th;
+    _accumulators = nullptr;
+
+    if (_thread != nullptr) {
+        accumulators(_thread->accumulators);
+    }
 
     assert(ok());
     return *this;
@@ -834,6 +891,11 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
 
     Key pKey{ posiKey()
             ^ RandZob.side };
+    // Polyglot key is updated along only if the previous one is known
+    bool const pgKeyed{ Book.inUse
+                     && _stateInfo->pgKey != 0 };
+    Key gKey{ _stateInfo->pgKey
+            ^ PolyZob.side };
 
     // Copy some fields of the old state to our new StateInfo object except the
     // ones which are going to be recalculated from scratch anyway and then switch
@@ -849,7 +911,7 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
     _stateInfo->promoted = false;
 
     // Used by NNUE
-    _stateInfo->accumulator.accumulationComputed = false;
+    claimAccumulator(*_stateInfo, _accumulators, 2 * ply);
     auto &mi{ _stateInfo->moveInfo };
     mi.pieceCount = 1;
 
@@ -897,6 +959,10 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
         placePiece(rookDst, cp);
         pKey ^= RandZob.psq[cp][rookOrg]
               ^ RandZob.psq[cp][rookDst];
+        if (pgKeyed) {
+            gKey ^= PolyZob.psq[cp][rookOrg]
+                  ^ PolyZob.psq[cp][rookDst];
+        }
 
         cp = NO_PIECE;
     }
@@ -938,6 +1004,9 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
             board[cap] = NO_PIECE; // Not done by removePiece()
         }
         pKey ^= RandZob.psq[cp][cap];
+        if (pgKeyed) {
+            gKey ^= PolyZob.psq[cp][cap];
+        }
         _stateInfo->matlKey ^= RandZob.psq[cp][count(cp)];
         // Reset clock ply counter
         _stateInfo->clockPly = 0;
@@ -956,11 +1025,18 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
     }
     pKey ^= RandZob.psq[mp][org]
           ^ RandZob.psq[mp][dst];
+    if (pgKeyed) {
+        gKey ^= PolyZob.psq[mp][org]
+              ^ PolyZob.psq[mp][dst];
+    }
 
     // Reset enpassant square
     if (epSquare() != SQ_NONE) {
         assert(1 >= clockPly());
         pKey ^= RandZob.enpassant[sFile(epSquare())];
+        if (pgKeyed) {
+            gKey ^= PolyZob.enpassant[sFile(epSquare())];
+        }
         _stateInfo->epSquare = SQ_NONE;
     }
 
@@ -968,8 +1044,14 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
     if (castleRights() != CR_NONE
      && (sqCastleRight[org]|sqCastleRight[dst]) != CR_NONE) {
         pKey ^= RandZob.castling[castleRights()];
+        if (pgKeyed) {
+            gKey ^= PolyZob.castling[castleRights()];
+        }
         _stateInfo->castleRights &= ~(sqCastleRight[org]|sqCastleRight[dst]);
         pKey ^= RandZob.castling[castleRights()];
+        if (pgKeyed) {
+            gKey ^= PolyZob.castling[castleRights()];
+        }
     }
 
     if (pType(mp) == PAWN) {
@@ -980,6 +1062,9 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
          && canEnpassant(pasive, org + PawnPush[active])) {
             _stateInfo->epSquare = org + PawnPush[active];
             pKey ^= RandZob.enpassant[sFile(_stateInfo->epSquare)];
+            if (pgKeyed) {
+                gKey ^= PolyZob.enpassant[sFile(_stateInfo->epSquare)];
+            }
         }
         else
         if (mType(m) == PROMOTE) {
@@ -1004,6 +1089,10 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
             npMaterial[active] += PieceValues[MG][pType(pp)];
             pKey ^= RandZob.psq[mp][dst]
                   ^ RandZob.psq[pp][dst];
+            if (pgKeyed) {
+                gKey ^= PolyZob.psq[mp][dst]
+                      ^ PolyZob.psq[pp][dst];
+            }
             _stateInfo->pawnKey ^= RandZob.psq[mp][dst];
             _stateInfo->matlKey ^= RandZob.psq[mp][count(mp)]
                                  ^ RandZob.psq[pp][count(pp) - 1];
@@ -1027,6 +1116,8 @@ void Position::doMove(Move m, StateInfo &si, bool isCheck) noexcept {
     active = pasive;
     // Update the key with the final value
     _stateInfo->posiKey = pKey;
+    _stateInfo->pgKey = pgKeyed    ? gKey :
+                        Book.inUse ? PolyZob.computePosiKey(*this) : 0;
 
     setCheckInfo();
 
@@ -1133,11 +1224,21 @@ void Position::doNullMove(StateInfo &si) noexcept {
     assert(&si != _stateInfo
         && checkers() == 0);
 
-    std::memcpy(&si, _stateInfo, Evaluator::useNNUE ? sizeof (StateInfo) : offsetof(StateInfo, accumulator));
+    std::memcpy(&si, _stateInfo, sizeof (StateInfo));
 
     si.prevState = _stateInfo;
     _stateInfo = &si;
 
+    // Used by NNUE
+    claimAccumulator(*_stateInfo, _accumulators, 2 * ply + 1);
+    if (Evaluator::useNNUE
+     && _stateInfo->prevState->accumulated()) {
+        std::memcpy(_stateInfo->accumulator->accumulation,
+                    _stateInfo->prevState->accumulator->accumulation,
+                    sizeof (_stateInfo->accumulator->accumulation));
+        _stateInfo->accumulator->accumulationComputed = true;
+    }
+
     ++_stateInfo->clockPly;
     _stateInfo->nullPly = 0;
     _stateInfo->captured = NONE;
@@ -1146,11 +1247,17 @@ void Position::doNullMove(StateInfo &si) noexcept {
     // Reset enpassant square
     if (epSquare() != SQ_NONE) {
         _stateInfo->posiKey ^= RandZob.enpassant[sFile(epSquare())];
+        if (_stateInfo->pgKey != 0) {
+            _stateInfo->pgKey ^= PolyZob.enpassant[sFile(epSquare())];
+        }
         _stateInfo->epSquare = SQ_NONE;
     }
 
     active = ~active;
     _stateInfo->posiKey ^= RandZob.side;
+    if (_stateInfo->pgKey != 0) {
+        _stateInfo->pgKey ^= PolyZob.side;
+    }
 
     setCheckInfo();
 
@@ -1203,7 +1310,11 @@ void Position::flip() {
     std::getline(iss, token, '\n');
     ff += token;
 
+    auto *const stack{ _accumulators };
     setup(ff, *_stateInfo, _thread);
+    if (stack != nullptr) {
+        accumulators(stack);
+    }
 
     assert(ok());
 }
@@ -1252,7 +1363,11 @@ void Position::mirror() {
     std::getline(iss, token, '\n');
     ff += token;
 
+    auto *const stack{ _accumulators };
     setup(ff, *_stateInfo, _thread);
+    if (stack != nullptr) {
+        accumulators(stack);
+    }
 
     assert(ok());
 }
@@ -1456,6 +1571,8 @@ bool Position::ok() const noexcept {
     if (matlKey() != RandZob.computeMatlKey(*this)
      || pawnKey() != RandZob.computePawnKey(*this)
      || posiKey() != RandZob.computePosiKey(*this)
+     || (_stateInfo->pgKey != 0
+      && _stateInfo->pgKey != PolyZob.computePosiKey(*this))
      || checkers() != (attackersTo(square(active|KING)) & pieces(~active))
      || popCount(checkers()) > 2
      || clockPly() > 2 * int16_t(Options["Draw MoveCount"])
@@ -4,6 +4,7 @@
 #include <deque>
 #include <memory> // For std::unique_ptr
 #include <string>
+#include <string_view>
 
 #include "bitboard.h"
 #include "psqtable.h"
@@ -24,6 +25,7 @@
 ///  - Bitboards of kingBlockers & kingCheckers
 ///  - Bitboards of all checking pieces
 ///  - Pointer to previous StateInfo
+///  - Pointer to NNUE accumulator (on the accumulator stack of the position)
 struct StateInfo {
     // ---Copied when making a move---
     Key         matlKey;        // Hash key of materials
@@ -35,6 +37,7 @@ struct StateInfo {
 
     // ---Not copied when making a move---
     Key         posiKey;        // Hash key of position
+    Key         pgKey;          // Polyglot key of position, maintained only while book is in use (zero otherwise)
     Bitboard    checkers;       // Checkers
     PieceType   captured;       // Piece type captured
     bool        promoted;
@@ -47,8 +50,14 @@ struct StateInfo {
     StateInfo *prevState; // Previous StateInfo pointer
 
     // Used by NNUE
-    Evaluator::NNUE::Accumulator accumulator;
+    Evaluator::NNUE::Accumulator *accumulator;
     MoveInfo moveInfo;
+
+    // Accumulator is valid only if still owned by this state
+    bool accumulated() const noexcept {
+        return accumulator->owner == this
+            && accumulator->accumulationComputed;
+    }
 };
 
 /// A list to keep track of the position states along the setup moves
@@ -58,6 +67,10 @@ struct StateInfo {
 using StateList     = std::deque<StateInfo>;
 using StateListPtr  = std::unique_ptr<StateList>;
 
+/// Forsyth-Edwards Notation (FEN) is a standard notation for describing a particular board position of a chess game.
+/// The purpose of FEN is to provide all the necessary information to restart a game from a particular position.
+constexpr std::string_view StartFEN{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" };
+
 class Thread;
 
 /// Position class stores information regarding the board representation:
@@ -134,6 +147,8 @@ public:
     int16_t gamePly() const noexcept;
     Thread* thread() const noexcept;
     void thread(Thread*) noexcept;
+    Evaluator::NNUE::Accumulator* accumulators() const noexcept;
+    void accumulators(Evaluator::NNUE::Accumulator*) noexcept;
 
     bool castleExpeded(Color, CastleSide) const noexcept;
 
@@ -161,7 +176,7 @@ public:
 
     PieceType captured(Move) const noexcept;
 
-    bool see(Move, Value = VALUE_ZERO) const noexcept;
+    bool see(Move, Value = VALUE_ZERO, Bitboard = 0) const noexcept;
 
     bool pawnPassedAt(Color, Square) const noexcept;
     Bitboard pawnsOnSqColor(Color, Color) const noexcept;
@@ -172,6 +187,7 @@ public:
 
     Position& setup(std::string_view, StateInfo&, Thread* = nullptr);
     Position& setup(std::string_view, Color, StateInfo&);
+    Position& setup(Position const&, StateInfo&, Thread*);
 
     void doMove(Move, StateInfo&, bool) noexcept;
     void doMove(Move, StateInfo&) noexcept;
@@ -225,6 +241,8 @@ private:
 
     StateInfo *_stateInfo;
     Thread    *_thread;
+    // Accumulator stack the states take their slot from, the thread's one unless set apart
+    Evaluator::NNUE::Accumulator *_accumulators;
 
     friend std::ostream& operator<<(std::ostream&, Position const&);
 };
@@ -365,6 +383,9 @@ inline Thread* Position::thread() const noexcept {
 inline void Position::thread(Thread *th) noexcept {
     _thread = th;
 }
+inline Evaluator::NNUE::Accumulator* Position::accumulators() const noexcept {
+    return _accumulators;
+}
 
 inline bool Position::castleExpeded(Color c, CastleSide cs) const noexcept {
     return (castleRookPath(c, cs) & pieces()) == 0;
@@ -13,6 +13,8 @@
 #include "notation.h"
 #include "polyglot.h"
 #include "position.h"
+#include "searchstats.h"
+#include "session.h"
 #include "syzygytb.h"
 #include "thread.h"
 #include "threadmarker.h"
@@ -53,16 +55,6 @@ inline void prefetch(void const*) noexcept {
 
 using Evaluator::evaluate;
 
-Limit Limits;
-
-namespace SyzygyTB {
-
-    Depth   DepthLimit;
-    int16_t PieceLimit;
-    bool    Move50Rule;
-    bool    HasRoot;
-}
-
 namespace {
 
     /// Stack keeps the information of the nodes in the tree during the search.
@@ -87,11 +79,9 @@ namespace {
     constexpr uint64_t TTHitAverageWindow{ 4096 };
     constexpr uint64_t TTHitAverageResolution{ 1024 };
 
-    constexpr int32_t MaxMoves{ 256 };
-    int32_t Reduction[MaxMoves];
-    inline Depth reduction(Depth d, uint8_t mc, bool imp) noexcept {
+    inline Depth reduction(Searcher::ReductionTable const &reductions, Depth d, uint8_t mc, bool imp) noexcept {
         assert(d >= DEPTH_ZERO);
-        auto const r{ Reduction[d] * Reduction[mc] };
+        auto const r{ reductions[d] * reductions[mc] };
         return Depth( (r + 509) / 1024 + 1 * (!imp && (r > 894)) );
     }
 
@@ -239,13 +229,14 @@ namespace {
     /// multipvInfo() formats PV information according to UCI protocol.
     /// UCI requires that all (if any) un-searched PV lines are sent using a previous search score.
     std::string multipvInfo(Thread const *th, Depth depth, Value alfa, Value beta) {
-        TimePoint const elapsed{ std::max(TimeMgr.elapsed(), { 1 }) };
-        auto const nodes{ Threadpool.accumulate(&Thread::nodes) };
-        auto const tbHits{ Threadpool.accumulate(&Thread::tbHits)
-                         + th->rootMoves.size() * SyzygyTB::HasRoot };
+        auto &session{ th->session };
+        TimePoint const elapsed{ std::max(session.timeMgr.elapsed(), { 1 }) };
+        auto const nodes{ session.threadpool.accumulate(&Thread::nodes) };
+        auto const tbHits{ session.threadpool.accumulate(&Thread::tbHits)
+                         + th->rootMoves.size() * session.threadpool.tbHasRoot };
 
         std::ostringstream oss;
-        for (uint16_t i = 0; i < Threadpool.pvCount; ++i) {
+        for (uint16_t i = 0; i < session.threadpool.pvCount; ++i) {
 
             bool const updated{ th->rootMoves[i].newValue != -VALUE_INFINITE };
 
@@ -262,7 +253,7 @@ namespace {
             }
 
             bool const tb{
-                SyzygyTB::HasRoot
+                session.threadpool.tbHasRoot
              && std::abs(v) < +VALUE_MATE_1_MAX_PLY };
             if (tb) {
                 v = th->rootMoves[i].tbValue;
@@ -287,10 +278,10 @@ namespace {
                 << " nps "      << nodes * 1000 / elapsed
                 << " tbhits "   << tbHits;
             if (elapsed > 1000) {
-            oss << " hashfull " << TT.hashFull();
+            oss << " hashfull " << session.tt.hashFull();
             }
             oss << " pv "       << th->rootMoves[i];
-            if (i + 1 < Threadpool.pvCount) {
+            if (i + 1 < session.threadpool.pvCount) {
             oss << '\n';
             }
         }
@@ -329,10 +320,11 @@ namespace {
         }
 
         Move move;
+        auto &session{ pos.thread()->session };
         // Transposition table lookup.
         Key const key     { pos.posiKey() };
 
-        auto *const tte   { TT.probe(key, ss->ttHit) };
+        auto *const tte   { session.tt.probe(key, ss->ttHit) };
 
         auto const ttValue{ ss->ttHit ? valueOfTT(tte->value(), ss->ply, pos.clockPly()) : VALUE_NONE };
         auto       ttMove { ss->ttHit ? tte->move() : MOVE_NONE };
@@ -370,7 +362,7 @@ namespace {
         }
         else {
             if (ss->ttHit) {
-                // Never assume anything on values stored in TT.
+                // Never assume anything on values stored in session.tt.
                 if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE) {
                     ss->staticEval = bestValue = evaluate(pos);
                 }
@@ -462,7 +454,7 @@ namespace {
              && !giveCheck
              && futilityBase > -VALUE_KNOWN_WIN
              && !pos.advancedPawnPush(move)
-             && Limits.mate == 0) {
+             && session.limits.mate == 0) {
                 assert(mType(move) != ENPASSANT); // Due to !pos.advancedPawnPush()
 
                 // Move Count pruning
@@ -490,7 +482,7 @@ namespace {
              && !(giveCheck
                && contains(pos.kingBlockers(~activeSide), org))
              && !pos.see(move)
-             && Limits.mate == 0) {
+             && session.limits.mate == 0) {
                 continue;
             }
 
@@ -502,7 +494,7 @@ namespace {
             }
 
             // Speculative prefetch as early as possible
-            prefetch(TT.cluster(pos.movePosiKey(move))->entry);
+            prefetch(session.tt.cluster(pos.movePosiKey(move))->entry);
 
             // Update the current move
             ss->playedMove = move;
@@ -589,11 +581,19 @@ namespace {
         ss->moveCount = 0;
         ss->inCheck = pos.checkers() != 0;
         auto *thread{ pos.thread() };
+        auto &session{ thread->session };
 
         // Check for the available remaining limit
-        if (thread == Threadpool.mainThread()) {
+        if (thread == session.threadpool.mainThread()) {
             static_cast<MainThread*>(thread)->tick();
         }
+        // In deterministic mode the threads take turns, a quantum of nodes each
+        if (thread->turnNodes != 0
+         && --thread->turnNodes == 0) {
+            thread->turnNodes = ThreadPool::TurnQuantum;
+            session.threadpool.passTurn(thread);
+        }
+        STATS_HIT(thread, NODE, depth);
 
         if (PVNode) {
             // Used to send selDepth info to GUI (selDepth from 1, ply from 0)
@@ -602,7 +602,7 @@ namespace {
 
         if (!rootNode) {
             // Step 2. Check for aborted search, immediate draw or maximum ply reached.
-            if (Threadpool.stop.load(std::memory_order::memory_order_relaxed)
+            if (session.threadpool.stop.load(std::memory_order::memory_order_relaxed)
              || pos.draw(ss->ply)
              || ss->ply >= MAX_PLY) {
                 return !ss->inCheck
@@ -654,8 +654,8 @@ namespace {
                                 pos.posiKey() ^ makeKey(excludedMove) };
 
         auto *const tte   { excludedMove == MOVE_NONE ?
-                                TT.probe(key, ss->ttHit) :
-                                TTEx.probe(key, ss->ttHit) };
+                                session.tt.probe(key, ss->ttHit) :
+                                session.ttEx.probe(key, ss->ttHit) };
 
         auto const ttValue{ ss->ttHit ? valueOfTT(tte->value(), ss->ply, pos.clockPly()) : VALUE_NONE };
         auto       ttMove { rootNode ? thread->rootMoves[thread->pvCur][0] :
@@ -717,18 +717,19 @@ namespace {
             }
 
             if (pos.clockPly() < 90) {
+                STATS_HIT(thread, TT_CUT, depth);
                 return ttValue;
             }
         }
 
         // Step 5. Tablebases probe.
         if (!rootNode
-         && SyzygyTB::PieceLimit != 0) {
+         && session.threadpool.tbPieceLimit != 0) {
             auto const pieceCount{ pos.count() };
 
-            if (( pieceCount  < SyzygyTB::PieceLimit
-              || (pieceCount == SyzygyTB::PieceLimit
-               && depth >= SyzygyTB::DepthLimit))
+            if (( pieceCount  < session.threadpool.tbPieceLimit
+              || (pieceCount == session.threadpool.tbPieceLimit
+               && depth >= session.threadpool.tbDepthLimit))
              && pos.clockPly() == 0
              && pos.castleRights() == CR_NONE) {
 
@@ -736,14 +737,14 @@ namespace {
                 auto const wdlScore{ SyzygyTB::probeWDL(pos, probeState) };
 
                 // Force check of time on the next occasion
-                if (thread == Threadpool.mainThread()) {
+                if (thread == session.threadpool.mainThread()) {
                     static_cast<MainThread*>(thread)->tickCount = 0;
                 }
 
                 if (probeState != SyzygyTB::ProbeState::PS_FAILURE) {
                     thread->tbHits.fetch_add(1, std::memory_order::memory_order_relaxed);
 
-                    int16_t const draw{ SyzygyTB::Move50Rule };
+                    int16_t const draw{ session.threadpool.tbMove50Rule };
 
                     value = wdlScore < -draw ? -VALUE_MATE_1_MAX_PLY + (ss->ply + 1) :
                             wdlScore > +draw ? +VALUE_MATE_1_MAX_PLY - (ss->ply + 1) :
@@ -802,7 +803,7 @@ namespace {
         else {
 
             if (ss->ttHit) {
-                // Never assume anything on values stored in TT.
+                // Never assume anything on values stored in session.tt.
                 if ((ss->staticEval = eval = tte->eval()) == VALUE_NONE) {
                     ss->staticEval = eval = evaluate(pos);
                 }
@@ -835,6 +836,7 @@ namespace {
              && depth == 1
                 // Razor Margin
              && eval <= alfa - 510) {
+                STATS_HIT(thread, RAZOR, depth);
                 return quienSearch<PVNode>(pos, ss, alfa, beta);
             }
 
@@ -850,7 +852,8 @@ namespace {
                 // Futility Margin
              && eval - 223 * (depth - 1 * improving) >= beta
              && eval < +VALUE_KNOWN_WIN // Don't return unproven wins.
-             && Limits.mate == 0) {
+             && session.limits.mate == 0) {
+                STATS_HIT(thread, FUTILITY, depth);
                 return eval;
             }
 
@@ -866,7 +869,8 @@ namespace {
              // Null move pruning disabled for activeSide until ply exceeds nmpPly
              && (ss->ply >= thread->nmpMinPly
               || activeSide != thread->nmpColor)
-             && Limits.mate == 0) {
+             && session.limits.mate == 0) {
+                STATS_HIT(thread, NULL_TRY, depth);
                 // Null move dynamic reduction based on depth and static evaluation.
                 Depth const nullDepth(
                     depth - ((982 + 85 * depth) / 256 + std::min(int32_t(eval - beta) / 192, 3)) );
@@ -877,7 +881,7 @@ namespace {
                   ^ (pos.epSquare() != SQ_NONE ? RandZob.enpassant[sFile(pos.epSquare())] : 0) };
 
                 // Speculative prefetch as early as possible
-                prefetch(TT.cluster(nullMoveKey)->entry);
+                prefetch(session.tt.cluster(nullMoveKey)->entry);
 
                 ss->playedMove = MOVE_NULL;
                 ss->pieceStats = &thread->continuationStats[0][0][NO_PIECE][0];
@@ -898,6 +902,7 @@ namespace {
                     if (thread->nmpMinPly != 0 // Recursive verification is not allowed
                      || (depth < 13
                       && std::abs(beta) < +VALUE_KNOWN_WIN)) {
+                        STATS_HIT(thread, NULL_CUT, depth);
                         return nullValue;
                     }
 
@@ -911,6 +916,7 @@ namespace {
                     thread->nmpMinPly = 0;
 
                     if (value >= beta) {
+                        STATS_HIT(thread, NULL_CUT, depth);
                         return nullValue;
                     }
                 }
@@ -933,7 +939,8 @@ namespace {
                && tte->depth() >= depth - 3
                && ttValue != VALUE_NONE
                && ttValue < probCutBeta)
-             && Limits.mate == 0) {
+             && session.limits.mate == 0) {
+                STATS_HIT(thread, PROBCUT_TRY, depth);
 
                 // if ttMove is a capture and value from transposition table is good enough produce probCut
                 // cutoff without digging into actual probCut search
@@ -943,6 +950,7 @@ namespace {
                  && ttValue >= probCutBeta
                  && ttMove != MOVE_NONE
                  && pos.captureOrPromotion(ttMove)) { 
+                    STATS_HIT(thread, PROBCUT_CUT, depth);
                     return probCutBeta;
                 }
 
@@ -977,7 +985,7 @@ namespace {
                     ++probCutCount;
 
                     // Speculative prefetch as early as possible
-                    prefetch(TT.cluster(pos.movePosiKey(move))->entry);
+                    prefetch(session.tt.cluster(pos.movePosiKey(move))->entry);
 
                     ss->playedMove = move;
                     // ss->inCheck{ false }, captureOrPromotion{ true }
@@ -1008,6 +1016,7 @@ namespace {
                                       BOUND_LOWER,
                                       ss->ttPV);
                         }
+                        STATS_HIT(thread, PROBCUT_CUT, depth);
                         return value;
                     }
                 }
@@ -1088,8 +1097,9 @@ namespace {
             ss->moveCount = ++moveCount;
 
             if (rootNode
-             && thread == Threadpool.mainThread()) {
-                TimePoint const elapsed{ TimeMgr.elapsed() };
+             && thread == session.threadpool.mainThread()
+             && !session.threadpool.quiet) {
+                TimePoint const elapsed{ session.timeMgr.elapsed() };
                 if (elapsed > 3000) {
                     sync_cout << std::setfill('0')
                               << "info"
@@ -1120,13 +1130,13 @@ namespace {
             if (!rootNode
              && pos.nonPawnMaterial(activeSide) != VALUE_ZERO
              && bestValue > -VALUE_MATE_2_MAX_PLY
-             && Limits.mate == 0) {
+             && session.limits.mate == 0) {
                 // Skip quiet moves if move count exceeds our futilityMoveCount() threshold
                 moveCountPruning = (moveCount >= futilityMoveCount(depth, improving));
                 movePicker.pickQuiets = !moveCountPruning;
 
                 // Reduced depth of the next LMR search.
-                Depth const lmrDepth( std::max(newDepth - reduction(depth, moveCount, improving), 0) );
+                Depth const lmrDepth( std::max(newDepth - reduction(session.threadpool.reductions, depth, moveCount, improving), 0) );
 
                 if (giveCheck
                  || captureOrPromotion) {
@@ -1135,10 +1145,12 @@ namespace {
                     if (!giveCheck
                      && lmrDepth < 1
                      && thread->captureStats[mp][dst][pos.captured(move)] < 0) {
+                        STATS_HIT(thread, HISTORY_PRUNE, depth);
                         continue;
                     }
                     // SEE based pruning: negative SEE (~25 ELO)
                     if (!pos.see(move, Value(-221 * depth))) {
+                        STATS_HIT(thread, SEE_PRUNE, depth);
                         continue;
                     }
                 }
@@ -1147,6 +1159,7 @@ namespace {
                     if (lmrDepth < 4 + ((ss-1)->stats > 0 || (ss-1)->moveCount == 1)
                      && (*pieceStats[0])[mp][dst] < CounterMovePruneThreshold
                      && (*pieceStats[1])[mp][dst] < CounterMovePruneThreshold) {
+                        STATS_HIT(thread, HISTORY_PRUNE, depth);
                         continue;
                     }
                     // Futility pruning: parent node. (~5 ELO)
@@ -1157,10 +1170,12 @@ namespace {
                        + (*pieceStats[1])[mp][dst]
                        + (*pieceStats[3])[mp][dst]
                        + (*pieceStats[5])[mp][dst] / 2 < 27376)) {
+                        STATS_HIT(thread, FUTILITY_MOVE, depth);
                         continue;
                     }
                     // SEE based pruning: negative SEE (~20 ELO)
                     if (!pos.see(move, Value(-(29 - std::min(lmrDepth, { 18 })) * nSqr(lmrDepth)))) {
+                        STATS_HIT(thread, SEE_PRUNE, depth);
                         continue;
                     }
                 }
@@ -1185,6 +1200,7 @@ namespace {
              && (tte->bound() & BOUND_LOWER)
              &&  tte->depth() >= depth - 3) {
 
+                STATS_HIT(thread, SINGULAR_TRY, depth);
                 Value const singularBeta( ttValue - ((4 + pastPV) * depth) / 2 );
                 Depth const singularDepth( (depth + 3 * pastPV - 1) / 2 );
 
@@ -1193,6 +1209,7 @@ namespace {
                 ss->excludedMove = MOVE_NONE;
 
                 if (value < singularBeta) {
+                    STATS_HIT(thread, SINGULAR_EXT, depth);
                     extension = 1;
                     singularQuietLMR = !ttmCapture;
                 }
@@ -1202,6 +1219,7 @@ namespace {
                 // multiple moves fail high, and can prune the whole subtree by returning the soft bound.
                 else
                 if (singularBeta >= beta) {
+                    STATS_HIT(thread, MULTI_CUT, depth);
                     return singularBeta;
                 }
                 // If the eval of ttMove is greater than beta we try also if there is an other move that
@@ -1213,6 +1231,7 @@ namespace {
                     ss->excludedMove = MOVE_NONE;
 
                     if (value >= beta) {
+                        STATS_HIT(thread, MULTI_CUT, depth);
                         return beta;
                     }
                 }
@@ -1243,7 +1262,7 @@ namespace {
             newDepth += extension;
 
             // Speculative prefetch as early as possible
-            prefetch(TT.cluster(pos.movePosiKey(move))->entry);
+            prefetch(session.tt.cluster(pos.movePosiKey(move))->entry);
 
             // Update the current move
             ss->playedMove = move;
@@ -1267,7 +1286,7 @@ namespace {
             // If the move fails high will be re-searched at full depth.
             if (doLMR) {
 
-                auto reductDepth{ reduction(depth, moveCount, improving) };
+                auto reductDepth{ reduction(session.threadpool.reductions, depth, moveCount, improving) };
 
                 reductDepth +=
                     // Increase if other threads are searching this position.
@@ -1335,6 +1354,10 @@ namespace {
 
                 doFullSearch = alfa < value
                             && d < newDepth;
+                STATS_HIT(thread, LMR, depth);
+                if (doFullSearch) {
+                    STATS_HIT(thread, LMR_RESEARCH, depth);
+                }
             }
             else {
                 doFullSearch = !PVNode
@@ -1374,8 +1397,8 @@ namespace {
             // Step 19. Check for the new best move.
             // Finished searching the move. If a stop or a cutoff occurred,
             // the return value of the search cannot be trusted,
-            // and return immediately without updating best move, PV and TT.
-            if (Threadpool.stop.load(std::memory_order::memory_order_relaxed)) {
+            // and return immediately without updating best move, PV and session.tt.
+            if (session.threadpool.stop.load(std::memory_order::memory_order_relaxed)) {
                 return VALUE_ZERO;
             }
 
@@ -1398,7 +1421,7 @@ namespace {
                     // This information is used for time management:
                     // When the best move changes frequently, allocate some more time.
                     if (moveCount >= 2
-                     && Limits.useTimeMgmt()) {
+                     && session.limits.useTimeMgmt()) {
                         ++thread->pvChanges;
                     }
                 }
@@ -1424,6 +1447,10 @@ namespace {
                     }
 
                     if (value >= beta) { // Fail high
+                        STATS_HIT(thread, CUT, depth);
+                        if (moveCount == 1) {
+                            STATS_HIT(thread, FIRST_CUT, depth);
+                        }
                         ss->stats = 0;
                         break;
                     }
@@ -1440,9 +1467,9 @@ namespace {
 
         // The following condition would detect a stop only after move loop has been
         // completed. But in this case bestValue is valid because we have fully
-        // searched our subtree, and we can anyhow save the result in TT.
+        // searched our subtree, and we can anyhow save the result in session.tt.
         /*
-        if (Threadpool.stop) {
+        if (session.threadpool.stop) {
             return VALUE_DRAW;
         }
         */
@@ -1539,12 +1566,13 @@ namespace {
 
 namespace Searcher {
 
-    void initialize() noexcept {
+    /// initialize() fills the reduction table for the given thread count
+    void initialize(ReductionTable &reductions, uint16_t threadCount) noexcept {
 
-        double const r{ 22.0 + 2 * std::log(Threadpool.size()) };
-        Reduction[0] = 0;
+        double const r{ 22.0 + 2 * std::log(threadCount) };
+        reductions[0] = 0;
         for (int16_t i = 1; i < MaxMoves; ++i) {
-            Reduction[i] = int32_t(r * std::log(i + 0.25 * std::log(i)));
+            reductions[i] = int32_t(r * std::log(i + 0.25 * std::log(i)));
         }
     }
 }
@@ -1555,21 +1583,25 @@ namespace Searcher {
 /// - Allocated thinking time has been consumed.
 /// - Maximum search depth is reached.
 void Thread::search() {
+    if (turnNodes != 0) {
+        session.threadpool.waitTurn(this);
+    }
+
     ttHitAvg = (TTHitAverageResolution / 2) * TTHitAverageWindow;
 
     int16_t timedContempt{ 0 };
     int32_t contemptTime{ Options["Contempt Time"] };
     if (contemptTime != 0
-     && Limits.useTimeMgmt()) {
+     && session.limits.useTimeMgmt()) {
         int64_t const diffTime{
-            (int64_t(Limits.clock[ rootPos.activeSide()].time)
-           - int64_t(Limits.clock[~rootPos.activeSide()].time)) / 1000 };
+            (int64_t(session.limits.clock[ rootPos.activeSide()].time)
+           - int64_t(session.limits.clock[~rootPos.activeSide()].time)) / 1000 };
         timedContempt = int16_t(diffTime / contemptTime);
     }
     // Basic Contempt
     int32_t bc{ toValue(int16_t(Options["Fixed Contempt"]) + timedContempt) };
     // In analysis mode, adjust contempt in accordance with user preference
-    if (Limits.infinite
+    if (session.limits.infinite
      || Options["UCI_AnalyseMode"]) {
         bc = Options["Analysis Contempt"] == "Off"                                    ? 0 :
              Options["Analysis Contempt"] == "White" && rootPos.activeSide() == BLACK ? -bc :
@@ -1583,7 +1615,7 @@ void Thread::search() {
     std::copy(&lowPlyStats[2][0], &lowPlyStats.back().back() + 1, &lowPlyStats[0][0]);
     std::fill(&lowPlyStats[MAX_LOWPLY - 2][0], &lowPlyStats.back().back() + 1, 0);
 
-    auto *mainThread{ this == Threadpool.mainThread() ?
+    auto *mainThread{ this == session.threadpool.mainThread() ?
                         static_cast<MainThread*>(this) : nullptr };
 
     if (mainThread != nullptr) {
@@ -1614,15 +1646,19 @@ void Thread::search() {
     Move pv[MAX_PLY+1];
     ss->pv = pv;
 
+#if defined(SEARCH_STATS)
+    uint64_t iterNodes{ 0 };
+#endif
+
     // Iterative deepening loop until requested to stop or the target depth is reached.
     while (++rootDepth < MAX_PLY
-        && !Threadpool.stop
+        && !session.threadpool.stop
         && (mainThread == nullptr
-         || Limits.depth == DEPTH_ZERO
-         || rootDepth <= Limits.depth)) {
+         || session.limits.depth == DEPTH_ZERO
+         || rootDepth <= session.limits.depth)) {
 
         if (mainThread != nullptr
-         && Limits.useTimeMgmt()) {
+         && session.limits.useTimeMgmt()) {
             // Age out PV variability metric
             pvChangesSum /= 2;
         }
@@ -1634,12 +1670,12 @@ void Thread::search() {
         pvBeg = 0;
         pvEnd = 0;
 
-        if (Threadpool.stand) {
+        if (session.threadpool.stand) {
             ++standCount;
         }
 
         // MultiPV loop. Perform a full root search for each PV line.
-        for (pvCur = 0; pvCur < Threadpool.pvCount && !Threadpool.stop; ++pvCur) {
+        for (pvCur = 0; pvCur < session.threadpool.pvCount && !session.threadpool.stop; ++pvCur) {
             if (pvCur == pvEnd) {
                 pvBeg = pvEnd;
                 while (++pvEnd < rootMoves.size()) {
@@ -1688,16 +1724,17 @@ void Thread::search() {
 
                 // If search has been stopped, break immediately.
                 // Sorting is safe because RootMoves is still valid, although it refers to the previous iteration.
-                if (Threadpool.stop) {
+                if (session.threadpool.stop) {
                     break;
                 }
 
                 // Give some update before to re-search.
-                if (Threadpool.pvCount == 1
+                if (session.threadpool.pvCount == 1
                  && mainThread != nullptr
+                 && !session.threadpool.quiet
                  && (bestValue <= alfa
                   || beta <= bestValue)
-                 && TimeMgr.elapsed() > 3000) {
+                 && session.timeMgr.elapsed() > 3000) {
                     sync_cout << multipvInfo(mainThread, rootDepth, alfa, beta) << sync_endl;
                 }
 
@@ -1733,37 +1770,43 @@ void Thread::search() {
             rootMoves.stableSort(pvBeg, pvCur + 1);
 
             if (mainThread != nullptr
-             && (Threadpool.stop
-              || Threadpool.pvCount == pvCur + 1
-              || TimeMgr.elapsed() > 3000)) {
+             && !session.threadpool.quiet
+             && (session.threadpool.stop
+              || session.threadpool.pvCount == pvCur + 1
+              || session.timeMgr.elapsed() > 3000)) {
                 sync_cout << multipvInfo(mainThread, rootDepth, alfa, beta) << sync_endl;
             }
         }
 
-        if (Threadpool.stop) {
+        if (session.threadpool.stop) {
             break;
         }
 
         finishedDepth = rootDepth;
+#if defined(SEARCH_STATS)
+        STATS_HIT(this, ITER, rootDepth);
+        STATS_ADD(this, ITER_NODES, rootDepth, nodes - iterNodes);
+        iterNodes = nodes;
+#endif
 
         // Has any of the threads found a "mate in <x>"?
-        if ( Limits.mate != 0
-         && !Limits.useTimeMgmt()
+        if ( session.limits.mate != 0
+         && !session.limits.useTimeMgmt()
          && bestValue >= +VALUE_MATE_1_MAX_PLY
-         && bestValue >= +VALUE_MATE - 2 * Limits.mate) {
-            Threadpool.stop = true;
+         && bestValue >= +VALUE_MATE - 2 * session.limits.mate) {
+            session.threadpool.stop = true;
         }
 
         if (mainThread != nullptr) {
             // If skill level is enabled and can pick move, pick a sub-optimal best move.
-            if (SkillMgr.enabled()
-             && SkillMgr.canPick(rootDepth)) {
-                SkillMgr.clear();
-                SkillMgr.pickBestMove();
+            if (session.skillMgr.enabled()
+             && session.skillMgr.canPick(rootDepth)) {
+                session.skillMgr.clear();
+                session.skillMgr.pickBestMove(session.threadpool);
             }
 
-            if ( Limits.useTimeMgmt()
-             && !Threadpool.stop
+            if ( session.limits.useTimeMgmt()
+             && !session.threadpool.stop
              && !mainThread->stopPonderhit) {
 
                 if (mainThread->bestMove != rootMoves[0][0]) {
@@ -1783,26 +1826,26 @@ void Thread::search() {
                               + 6 * (mainThread->iterValues[iterIdx] - bestValue)) / 825.0,
                                 0.50, 1.50) };
 
-                pvChangesSum += Threadpool.accumulate(&Thread::pvChanges);
+                pvChangesSum += session.threadpool.accumulate(&Thread::pvChanges);
                 // Set pvChanges to 0
-                Threadpool.set(&Thread::pvChanges, { 0 });
-                auto const pvInstability{ 1.00 + 2 * pvChangesSum / Threadpool.size() };
+                session.threadpool.set(&Thread::pvChanges, { 0 });
+                auto const pvInstability{ 1.00 + 2 * pvChangesSum / session.threadpool.size() };
 
                 TimePoint const totalTime(
                     rootMoves.size() > 1 ?
-                        TimeMgr.optimum()
+                        session.timeMgr.optimum()
                       * reductionRatio
                       * fallingEval
                       * pvInstability : 0);
 
-                TimePoint const elapsed{ TimeMgr.elapsed() };
+                TimePoint const elapsed{ session.timeMgr.elapsed() };
 
                 // Stop the search if we have exceeded the totalTime (at least 1ms).
                 if (elapsed > totalTime) {
                     // If allowed to ponder do not stop the search now but
                     // keep pondering until GUI sends "stop"/"ponderhit".
                     if (!mainThread->ponder) {
-                        Threadpool.stop = true;
+                        session.threadpool.stop = true;
                     }
                     else {
                         mainThread->stopPonderhit = true;
@@ -1811,7 +1854,7 @@ void Thread::search() {
                 else
                 if (elapsed > totalTime * 0.58) {
                     if (!mainThread->ponder) {
-                        Threadpool.stand = true;
+                        session.threadpool.stand = true;
                     }
                 }
 
@@ -1824,21 +1867,33 @@ void Thread::search() {
     if (mainThread != nullptr) {
         mainThread->timeReduction = timeReduction;
     }
+
+    if (turnNodes != 0) {
+        // The main thread stops the others while still in turn, so they all stop at the same node on every run
+        if (mainThread != nullptr
+         && !mainThread->ponder
+         && !session.limits.infinite) {
+            session.threadpool.stop = true;
+        }
+        session.threadpool.leaveTurns(this);
+    }
 }
 
 /// MainThread::search() is main thread search function.
 /// It searches from root position and outputs the "bestmove"/"ponder".
 void MainThread::search() {
-    assert(Threadpool.mainThread() == this);
+    assert(session.threadpool.mainThread() == this);
 
-    if (Limits.useTimeMgmt()) {
+    if (session.limits.useTimeMgmt()) {
         // Initialize the time manager before searching.
-        TimeMgr.setup(rootPos.activeSide(), rootPos.gamePly());
+        session.timeMgr.setup(rootPos.activeSide(), rootPos.gamePly());
     }
 
     TEntry::updateGeneration();
 
-    Evaluator::NNUE::verify();
+    if (!session.threadpool.quiet) {
+        Evaluator::NNUE::verify();
+    }
 
     bool think{ true };
 
@@ -1847,16 +1902,18 @@ void MainThread::search() {
 
         rootMoves += MOVE_NONE;
 
-        sync_cout << "info"
-                  << " depth " << 0
-                  << " score " << toString(rootPos.checkers() != 0 ? -VALUE_MATE : VALUE_DRAW)
-                  << " time "  << 0 << sync_endl;
+        if (!session.threadpool.quiet) {
+            sync_cout << "info"
+                      << " depth " << 0
+                      << " score " << toString(rootPos.checkers() != 0 ? -VALUE_MATE : VALUE_DRAW)
+                      << " time "  << 0 << sync_endl;
+        }
     }
     else {
 
-        if (!Limits.infinite
+        if (!session.limits.infinite
          &&  Options["Use Book"]
-         &&  Limits.mate == 0) {
+         &&  session.limits.mate == 0) {
             auto bbm{ Book.probe(rootPos, Options["Book Move Num"], Options["Book Pick Best"]) };
             if (bbm != MOVE_NONE
              && rootMoves.contains(bbm)) {
@@ -1876,7 +1933,7 @@ void MainThread::search() {
 
         if (think) {
 
-            if (Limits.useTimeMgmt()) {
+            if (session.limits.useTimeMgmt()) {
                 bestMove = MOVE_NONE;
                 bestDepth = DEPTH_ZERO;
             }
@@ -1887,21 +1944,21 @@ void MainThread::search() {
                     std::clamp(std::pow((double(Options["UCI_Elo"]) - 1346.6) / 143.4, 1 / 0.806), 0.0, double(MaxLevel)) :
                     double(Options["Skill Level"]) };
             uint16_t const intLevel = uint16_t(dbllevel) + ((dbllevel - uint16_t(dbllevel)) * 1024 > prng.rand<uint32_t>() % 1024 ? 1 : 0);
-            SkillMgr.setLevel(intLevel);
+            session.skillMgr.setLevel(intLevel);
 
             // Have to play with skill handicap?
             // In this case enable MultiPV search by skill pv size
             // that will use behind the scenes to get a set of possible moves.
-            Threadpool.pvCount = std::clamp(uint16_t(Options["MultiPV"]),
-                                            uint16_t(1 + 3 * SkillMgr.enabled()),
+            session.threadpool.pvCount = std::clamp(uint16_t(Options["MultiPV"]),
+                                            uint16_t(1 + 3 * session.skillMgr.enabled()),
                                             uint16_t(rootMoves.size()));
 
-            Threadpool.wakeUpThreads(); // start non-main threads searching !
+            session.threadpool.wakeUpThreads(); // start non-main threads searching !
             Thread::search();           // start main thread searching !
 
             // Swap best PV line with the sub-optimal one if skill level is enabled
-            if (SkillMgr.enabled()) {
-                rootMoves.bringToFront(SkillMgr.pickBestMove());
+            if (session.skillMgr.enabled()) {
+                rootMoves.bringToFront(session.skillMgr.pickBestMove(session.threadpool));
             }
         }
     }
@@ -1911,28 +1968,29 @@ void MainThread::search() {
     // before receiving a "stop"/"ponderhit" command. Therefore simply wait here until
     // receives one of those commands (which also raises Threads.stop).
     // Busy wait for a "stop"/"ponderhit" command.
-    while (!Threadpool.stop
+    while (!session.threadpool.stop
         && (ponder
-         || Limits.infinite)) {
+         || session.limits.infinite)) {
     } // Busy wait for a stop or a ponder reset
 
     Thread *bestThread{ this };
     if (think) {
         // Stop the threads if not already stopped (Also raise the stop if "ponderhit" just reset Threads.ponder)
-        Threadpool.stop = true;
+        session.threadpool.stop = true;
         // Wait until non-main threads have finished
-        Threadpool.waitForThreads();
+        session.threadpool.waitForThreads();
 
         // Check if there is better thread than main thread
-        if (Threadpool.pvCount == 1
-         && Threadpool.size() >= 2
-         //&& Limits.depth == DEPTH_ZERO // Depth limit search don't use deeper thread
-         && !SkillMgr.enabled()
+        if (session.threadpool.pvCount == 1
+         && session.threadpool.size() >= 2
+         //&& session.limits.depth == DEPTH_ZERO // Depth limit search don't use deeper thread
+         && !session.skillMgr.enabled()
          && !Options["UCI_LimitStrength"]) {
 
-            bestThread = Threadpool.bestThread();
+            bestThread = session.threadpool.bestThread();
             // If new best thread then send PV info again
-            if (bestThread != this) {
+            if (bestThread != this
+             && !session.threadpool.quiet) {
                 sync_cout << multipvInfo(bestThread, bestThread->finishedDepth, -VALUE_INFINITE, +VALUE_INFINITE) << sync_endl;
             }
         }
@@ -1943,11 +2001,11 @@ void MainThread::search() {
 
     auto &rm{ bestThread->rootMoves[0] };
 
-    if (Limits.useTimeMgmt()) {
+    if (session.limits.useTimeMgmt()) {
         if (uint16_t(Options["Time Nodes"]) != 0) {
             // In 'Nodes as Time' mode, subtract the searched nodes from the total nodes.
-            TimeMgr.remainingNodes += Limits.clock[rootPos.activeSide()].inc
-                                    - Threadpool.accumulate(&Thread::nodes);
+            session.timeMgr.remainingNodes += session.limits.clock[rootPos.activeSide()].inc
+                                    - session.threadpool.accumulate(&Thread::nodes);
         }
         bestValue = rm.newValue;
     }
@@ -1956,16 +2014,30 @@ void MainThread::search() {
     auto pm{ MOVE_NONE };
     if (bm != MOVE_NONE) {
         auto const itr{ rm.begin() + 1 };
-        pm = itr != rm.end() ? *itr : TT.extractNextMove(rootPos, bm);
+        pm = itr != rm.end() ? *itr : session.tt.extractNextMove(rootPos, bm);
         assert(bm != pm);
     }
 
+    uint64_t tbCacheHits{ 0 },
+             tbCacheProbes{ 0 };
+    for (auto const *th : session.threadpool) {
+        tbCacheHits   += th->tbCache.hits;
+        tbCacheProbes += th->tbCache.probes;
+    }
+    if (session.threadpool.quiet) {
+        return;
+    }
+    if (tbCacheProbes != 0) {
+        sync_cout << "info string Syzygy cache hits " << tbCacheHits << " of " << tbCacheProbes
+                  << " (" << tbCacheHits * 100 / tbCacheProbes << "%)" << sync_endl;
+    }
+
     // Best move could be MOVE_NONE when searching on a stalemate position.
     sync_cout << "bestmove " << bm;
     if (pm != MOVE_NONE) {
-        std::cout << " ponder " << pm;
+        SyncOutput << " ponder " << pm;
     }
-    std::cout << sync_endl;
+    SyncOutput << sync_endl;
 }
 
 /// MainThread::tick() is used as timer function.
@@ -1977,10 +2049,14 @@ void MainThread::tick() {
         return;
     }
     // When using nodes, ensure checking rate is in range [1, 1024]
-    tickCount = int16_t(Limits.nodes != 0 ? std::clamp(int32_t(Limits.nodes / 1024), 1, 1024) : 1024);
+    tickCount = int16_t(session.limits.nodes != 0 ? std::clamp(int32_t(session.limits.nodes / 1024), 1, 1024) : 1024);
+
+    // Bounded cost whatever the number of threads, but the count lags behind by up to threads/16 ticks:
+    // a nodes limit can be overshot by the nodes searched in those ticks ('bench tick' measures both)
+    auto const nodeCount{ session.threadpool.sampleNodes() };
 
-    TimePoint elapsed{ TimeMgr.elapsed() };
-    TimePoint time{ TimeMgr.startTime + elapsed };
+    TimePoint elapsed{ session.timeMgr.elapsed(nodeCount) };
+    TimePoint time{ session.timeMgr.startTime + elapsed };
 
     if (reportTime + 1000 <= time) {
         reportTime = time;
@@ -1993,14 +2069,14 @@ void MainThread::tick() {
         return;
     }
 
-    if ((Limits.useTimeMgmt()
+    if ((session.limits.useTimeMgmt()
       && (stopPonderhit
-       || TimeMgr.maximum() < elapsed + 10))
-     || (Limits.moveTime != 0
-      && Limits.moveTime <= elapsed)
-     || (Limits.nodes != 0
-      && Limits.nodes <= Threadpool.accumulate(&Thread::nodes))) {
-        Threadpool.stop = true;
+       || session.timeMgr.maximum() < elapsed + 10))
+     || (session.limits.moveTime != 0
+      && session.limits.moveTime <= elapsed)
+     || (session.limits.nodes != 0
+      && session.limits.nodes <= nodeCount)) {
+        session.threadpool.stop = true;
     }
 }
 
@@ -2008,33 +2084,41 @@ namespace SyzygyTB {
 
     void rankRootMoves(Position &pos, RootMoves &rootMoves) {
 
-        DepthLimit = Options["SyzygyDepthLimit"];
-        PieceLimit = Options["SyzygyPieceLimit"];
-        Move50Rule = Options["SyzygyMove50Rule"];
-        HasRoot    = false;
+        auto &session{ pos.thread()->session };
+        session.threadpool.tbDepthLimit = Options["SyzygyDepthLimit"];
+        session.threadpool.tbPieceLimit = Options["SyzygyPieceLimit"];
+        session.threadpool.tbMove50Rule = Options["SyzygyMove50Rule"];
+        session.threadpool.tbHasRoot    = false;
 
         bool dtzAvailable{ true };
 
-        // Tables with fewer pieces than SyzygyProbeLimit are searched with DepthLimit == DEPTH_ZERO
-        if (PieceLimit > MaxPieceLimit) {
-            PieceLimit = MaxPieceLimit;
-            DepthLimit = DEPTH_ZERO;
+        // Tables with fewer pieces than SyzygyProbeLimit are searched with tbDepthLimit == DEPTH_ZERO
+        if (session.threadpool.tbPieceLimit > MaxPieceLimit) {
+            session.threadpool.tbPieceLimit = MaxPieceLimit;
+            session.threadpool.tbDepthLimit = DEPTH_ZERO;
         }
 
         // Rank moves using DTZ tables
-        if (PieceLimit >= pos.count()
+        if (session.threadpool.tbPieceLimit >= pos.count()
          && pos.castleRights() == CR_NONE) {
+            auto const startTime{ now() };
             // If the current root position is in the table-bases,
             // then RootMoves contains only moves that preserve the draw or the win.
-            HasRoot = rootProbeDTZ(pos, rootMoves);
-            if (!HasRoot) {
+            session.threadpool.tbHasRoot = rootProbeDTZ(pos, rootMoves);
+            if (!session.threadpool.tbHasRoot) {
                 // DTZ tables are missing; try to rank moves using WDL tables
                 dtzAvailable = false;
-                HasRoot = rootProbeWDL(pos, rootMoves);
+                session.threadpool.tbHasRoot = rootProbeWDL(pos, rootMoves);
+            }
+            if (session.threadpool.tbHasRoot
+             && !session.threadpool.quiet) {
+                sync_cout << "info string Tablebases ranked " << rootMoves.size()
+                          << " root moves by " << (dtzAvailable ? "DTZ" : "WDL")
+                          << " in " << now() - startTime << " ms" << sync_endl;
             }
         }
 
-        if (HasRoot) {
+        if (session.threadpool.tbHasRoot) {
             // Sort moves according to TB rank
             rootMoves.stableSort([](RootMove const &rm1, RootMove const &rm2) {
                                     return rm1.tbRank > rm2.tbRank;
@@ -2042,7 +2126,7 @@ namespace SyzygyTB {
             // Probe during search only if DTZ is not available and winning
             if (dtzAvailable
              || rootMoves[0].tbValue <= VALUE_DRAW) {
-                PieceLimit = 0;
+                session.threadpool.tbPieceLimit = 0;
             }
         }
         else {
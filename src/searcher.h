@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "type.h"
 
 // Threshold for counter moves based pruning
@@ -51,7 +53,7 @@ struct Limit {
     uint8_t   movestogo;    // Search <x> moves to the next time control
     TimePoint moveTime;     // Search <x> exact time in milli-seconds
     Depth     depth;        // Search <x> depth(plies) only
-    uint64_t  nodes;        // Search <x> nodes only
+    uint64_t  nodes;        // Search <x> nodes only (may overshoot, see MainThread::tick())
     uint8_t   mate;         // Search mate in <x> moves
     bool      infinite;     // Search until the "stop" command
     Moves     searchMoves;  // Restrict search to these root moves only
@@ -59,8 +61,10 @@ struct Limit {
 
 namespace Searcher {
 
-    extern void initialize() noexcept;
-}
+    constexpr int32_t MaxMoves{ 256 };
+    /// ReductionTable is the base of the late move reductions, by depth and by move count.
+    /// It depends on the thread count, so every threadpool has its own.
+    using ReductionTable = std::array<int32_t, MaxMoves>;
 
-// Global Limit
-extern Limit Limits;
+    extern void initialize(ReductionTable&, uint16_t) noexcept;
+}
@@ -0,0 +1,179 @@
+#include "searchstats.h"
+
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "thread.h"
+
+namespace SearchStats {
+
+    namespace {
+
+        Table Total;
+
+        constexpr char const *Names[COUNTERS]{
+            "nodes", "ttCut", "razor", "futility",
+            "nullTry", "nullCut", "probCutTry", "probCutCut",
+            "singularTry", "singularExt", "multiCut",
+            "historyPrune", "futilityMove", "seePrune",
+            "lmr", "lmrResearch", "cut", "firstCut",
+            "iterations", "iterationNodes"
+        };
+
+        double percent(uint64_t num, uint64_t den) noexcept {
+            return den != 0 ? 100.0 * num / den : 0.0;
+        }
+
+        /// ebf() returns the effective branching factor at the depth:
+        /// the mean nodes of an iteration over the mean nodes of the previous one, zero if unknown.
+        double ebf(int16_t d) noexcept {
+            if (d < 2
+             || d >= DEPTHS - 1
+             || Total[d][ITER] == 0
+             || Total[d-1][ITER] == 0
+             || Total[d-1][ITER_NODES] == 0) {
+                return 0.0;
+            }
+            return (double(Total[d][ITER_NODES]) / Total[d][ITER])
+                 / (double(Total[d-1][ITER_NODES]) / Total[d-1][ITER]);
+        }
+
+        /// meanEBF() returns the geometric mean of the known effective branching factors.
+        double meanEBF() noexcept {
+            double logSum{ 0.0 };
+            int16_t count{ 0 };
+            for (int16_t d = 2; d < DEPTHS - 1; ++d) {
+                auto const f{ ebf(d) };
+                if (f > 0.0) {
+                    logSum += std::log(f);
+                    ++count;
+                }
+            }
+            return count != 0 ? std::exp(logSum / count) : 0.0;
+        }
+
+        std::array<uint64_t, COUNTERS> sum() noexcept {
+            std::array<uint64_t, COUNTERS> total{};
+            for (auto const &row : Total) {
+                for (uint8_t c = 0; c < COUNTERS; ++c) {
+                    total[c] += row[c];
+                }
+            }
+            return total;
+        }
+
+        void printRow(std::ostream &os, std::array<uint64_t, COUNTERS> const &row, double f) {
+            os  << std::setw(10) << row[NODE]
+                << std::setw( 8) << percent(row[TT_CUT], row[NODE])
+                << std::setw( 9) << row[RAZOR]
+                << std::setw( 9) << row[FUTILITY]
+                << std::setw( 9) << row[NULL_TRY]
+                << std::setw( 8) << percent(row[NULL_CUT], row[NULL_TRY])
+                << std::setw( 9) << row[PROBCUT_TRY]
+                << std::setw( 8) << percent(row[PROBCUT_CUT], row[PROBCUT_TRY])
+                << std::setw( 9) << row[SINGULAR_TRY]
+                << std::setw( 8) << percent(row[SINGULAR_EXT], row[SINGULAR_TRY])
+                << std::setw( 9) << row[MULTI_CUT]
+                << std::setw(10) << row[HISTORY_PRUNE]
+                << std::setw(10) << row[FUTILITY_MOVE]
+                << std::setw(10) << row[SEE_PRUNE]
+                << std::setw(10) << row[LMR]
+                << std::setw( 8) << percent(row[LMR_RESEARCH], row[LMR])
+                << std::setw( 8) << percent(row[CUT], row[NODE])
+                << std::setw( 8) << percent(row[FIRST_CUT], row[CUT])
+                << std::setw( 7) << f << '\n';
+        }
+
+        void printJSONRow(std::ostream &os, std::array<uint64_t, COUNTERS> const &row, double f) {
+            for (uint8_t c = 0; c < COUNTERS; ++c) {
+                os << '"' << Names[c] << "\": " << row[c] << ", ";
+            }
+            os << "\"ebf\": " << f;
+        }
+    }
+
+    void reset() noexcept {
+        for (auto &row : Total) {
+            row.fill(0);
+        }
+    }
+
+    /// merge() adds the counters of the threads to the total and clears them.
+    void merge(ThreadPool const &threadpool) noexcept {
+#if defined(SEARCH_STATS)
+        for (auto *th : threadpool) {
+            for (int16_t d = 0; d < DEPTHS; ++d) {
+                for (uint8_t c = 0; c < COUNTERS; ++c) {
+                    Total[d][c] += th->searchStats[d][c];
+                }
+                th->searchStats[d].fill(0);
+            }
+        }
+#else
+        (void)threadpool;
+#endif
+    }
+
+    bool empty() noexcept {
+        return sum()[NODE] == 0;
+    }
+
+    /// print() writes a table of the counters by depth, the rates are in percent.
+    void print(std::ostream &os) {
+        std::ostringstream oss;
+        oss << std::right << std::fixed << std::setprecision(2)
+            << "Depth"
+            << std::setw(10) << "Nodes"
+            << std::setw( 8) << "TTCut%"
+            << std::setw( 9) << "Razor"
+            << std::setw( 9) << "Futility"
+            << std::setw( 9) << "Null"
+            << std::setw( 8) << "NCut%"
+            << std::setw( 9) << "ProbCut"
+            << std::setw( 8) << "PCut%"
+            << std::setw( 9) << "Singular"
+            << std::setw( 8) << "SExt%"
+            << std::setw( 9) << "MultiCut"
+            << std::setw(10) << "HistPrune"
+            << std::setw(10) << "FutPrune"
+            << std::setw(10) << "SeePrune"
+            << std::setw(10) << "LMR"
+            << std::setw( 8) << "LMRRe%"
+            << std::setw( 8) << "Cut%"
+            << std::setw( 8) << "1stCut%"
+            << std::setw( 7) << "EBF" << '\n';
+        for (int16_t d = 0; d < DEPTHS; ++d) {
+            if (Total[d][NODE] != 0
+             || Total[d][ITER] != 0) {
+                oss << std::setw(4) << d << (d == DEPTHS - 1 ? "+" : " ");
+                printRow(oss, Total[d], ebf(d));
+            }
+        }
+        oss << "  All";
+        printRow(oss, sum(), meanEBF());
+        os << oss.str();
+    }
+
+    /// printJSON() writes the counters by depth and their totals as a JSON object.
+    void printJSON(std::ostream &os) {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(3)
+            << "{ \"depths\": [";
+        bool first{ true };
+        for (int16_t d = 0; d < DEPTHS; ++d) {
+            if (Total[d][NODE] != 0
+             || Total[d][ITER] != 0) {
+                oss << (first ? "\n    " : ",\n    ")
+                    << "{ \"depth\": " << d << ", ";
+                printJSONRow(oss, Total[d], ebf(d));
+                oss << " }";
+                first = false;
+            }
+        }
+        oss << " ],\n  \"total\": { ";
+        printJSONRow(oss, sum(), meanEBF());
+        oss << " } }";
+        os << oss.str();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <ostream>
+
+class ThreadPool;
+
+/// SearchStats counts per thread and per depth how often each pruning, reduction and extension
+/// of the search applies, to tune for node efficiency.
+/// Counting is compiled in only with SEARCH_STATS defined (make stats=yes), otherwise it costs nothing.
+namespace SearchStats {
+
+    enum Counter : uint8_t {
+        NODE,           // depthSearch() nodes
+        TT_CUT,         // Transposition table cutoffs
+        RAZOR,          // Razoring, dropped into quiescence search
+        FUTILITY,       // Futility pruning of the node (child node)
+        NULL_TRY,       // Null move searches
+        NULL_CUT,       // Null move cutoffs
+        PROBCUT_TRY,    // ProbCut attempts
+        PROBCUT_CUT,    // ProbCut cutoffs
+        SINGULAR_TRY,   // Singular extension searches
+        SINGULAR_EXT,   // Singular extensions
+        MULTI_CUT,      // Multi-cut cutoffs of the singular search
+        HISTORY_PRUNE,  // Moves pruned by capture or continuation history
+        FUTILITY_MOVE,  // Moves pruned by futility (parent node)
+        SEE_PRUNE,      // Moves pruned by negative SEE
+        LMR,            // Reduced searches
+        LMR_RESEARCH,   // Reduced searches failing high, re-searched at full depth
+        CUT,            // Beta cutoffs of the move loop
+        FIRST_CUT,      // Beta cutoffs on the first move
+        ITER,           // Completed iterations (by root depth)
+        ITER_NODES,     // Nodes of the completed iterations (by root depth)
+        COUNTERS
+    };
+
+    /// Depths from DEPTHS-1 on are counted together
+    constexpr int16_t DEPTHS{ 32 };
+
+    using Table = std::array<std::array<uint64_t, COUNTERS>, DEPTHS>;
+
+    extern void reset() noexcept;
+    extern void merge(ThreadPool const&) noexcept;
+    extern bool empty() noexcept;
+
+    extern void print(std::ostream&);
+    extern void printJSON(std::ostream&);
+}
+
+#if defined(SEARCH_STATS)
+    #define STATS_ADD(th, counter, depth, n) \
+        ((th)->searchStats[std::min(int32_t(depth), SearchStats::DEPTHS - 1)][SearchStats::counter] += (n))
+#else
+    #define STATS_ADD(th, counter, depth, n) ((void)0)
+#endif
+#define STATS_HIT(th, counter, depth) STATS_ADD(th, counter, depth, 1)
@@ -0,0 +1,52 @@
+#include "session.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+    // All the living sessions, guarded by Session::SharedMutex
+    std::vector<Session const*> Sessions;
+}
+
+std::mutex Session::SharedMutex;
+
+Session MainSession{ 0 };
+
+thread_local Session const *CurrentSession{ &MainSession };
+
+Session::Session(uint32_t sessionId) noexcept :
+    id{ sessionId },
+    outputPrefix{ sessionId != 0 ? "session " + std::to_string(sessionId) + " " : "" },
+    threadpool{ *this },
+    timeMgr{ *this },
+    accumulators(Thread::AccumulatorSlots) {
+
+    std::lock_guard<std::mutex> lockGuard(SharedMutex);
+    Sessions.push_back(this);
+}
+
+Session::~Session() noexcept {
+    std::lock_guard<std::mutex> lockGuard(SharedMutex);
+    Sessions.erase(std::find(Sessions.begin(), Sessions.end(), this));
+}
+
+/// Session::clear() stops the search and clears the hash tables, the time manager and the thread stats.
+void Session::clear() noexcept {
+    threadpool.stop = true;
+    threadpool.mainThread()->waitIdle();
+
+    tt.clear();
+    ttEx.clear();
+    timeMgr.clear();
+    threadpool.clean();
+}
+
+/// Session::othersSearching() checks whether any other session is searching,
+/// SharedMutex should be held, so that no search starts meanwhile.
+bool Session::othersSearching() const noexcept {
+    return std::any_of(Sessions.begin(), Sessions.end(), [&](Session const *session) {
+        return session != this
+            && session->threadpool.searching();
+    });
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "searcher.h"
+#include "skillmanager.h"
+#include "thread.h"
+#include "timemanager.h"
+#include "transposition.h"
+
+/// Session keeps together everything an independent game or analysis owns:
+/// the threads, the transposition tables, the search limits, the time and skill managers.
+/// The search reaches its session through the searching thread (Thread::session),
+/// the commands through the session they are executed for.
+/// Read-only data (attack tables, bitbases, NNUE weights, Syzygy mappings, book) and the options
+/// stay process-wide and are shared by all the sessions, they are changed only under SharedMutex
+/// while no other session is searching.
+class Session final {
+
+public:
+
+    explicit Session(uint32_t) noexcept;
+    ~Session() noexcept;
+
+    Session(Session const&) = delete;
+    Session(Session&&) = delete;
+
+    Session& operator=(Session const&) = delete;
+    Session& operator=(Session&&) = delete;
+
+    void clear() noexcept;
+
+    bool othersSearching() const noexcept;
+
+    uint32_t const id;
+    // Prepended to every output line of the session, empty for the main session
+    std::string const outputPrefix;
+
+    ThreadPool   threadpool;
+    TTable       tt;
+    TTable       ttEx;
+    Limit        limits;
+    TimeManager  timeMgr;
+    SkillManager skillMgr;
+    // Accumulator stack of the position set up by the commands, apart from the ones of the searching threads
+    std::vector<Evaluator::NNUE::Accumulator> accumulators;
+
+    // Held while the shared data changes and while a search starts
+    static std::mutex SharedMutex;
+};
+
+// Main Session, the one driven by the plain UCI commands
+extern Session MainSession;
+
+// Session whose output the calling thread writes, only used to prefix the output lines.
+// The command thread of a session and its threads set it, other threads write for the main session.
+extern thread_local Session const *CurrentSession;
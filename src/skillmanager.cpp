@@ -4,9 +4,7 @@
 #include "thread.h"
 #include "helper/prng.h"
 
-SkillManager SkillMgr;
-
-constexpr SkillManager::SkillManager() noexcept :
+SkillManager::SkillManager() noexcept :
     level{ MaxLevel },
     bestMove{ MOVE_NONE } {
 }
@@ -30,19 +28,19 @@ void SkillManager::clear() noexcept {
 
 /// SkillManager::pickBestMove() chooses best move among a set of RootMoves when playing with a strength handicap,
 /// using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
-Move SkillManager::pickBestMove() noexcept {
+Move SkillManager::pickBestMove(ThreadPool const &threadpool) noexcept {
     static PRNG prng(now()); // PRNG sequence should be non-deterministic.
 
     if (bestMove == MOVE_NONE) {
-        auto const &rootMoves{ Threadpool.mainThread()->rootMoves };
+        auto const &rootMoves{ threadpool.mainThread()->rootMoves };
         assert(!rootMoves.empty());
 
         // RootMoves are already sorted by value in descending order
         int32_t const weakness{ MAX_PLY / 2 - 2 * level };
-        int32_t const deviance{ std::min(rootMoves[0].newValue - rootMoves[Threadpool.pvCount - 1].newValue, VALUE_MG_PAWN) };
+        int32_t const deviance{ std::min(rootMoves[0].newValue - rootMoves[threadpool.pvCount - 1].newValue, VALUE_MG_PAWN) };
 
         auto bestValue{ -VALUE_INFINITE };
-        for (uint16_t i = 0; i < Threadpool.pvCount; ++i) {
+        for (uint16_t i = 0; i < threadpool.pvCount; ++i) {
             // First for each move score add two terms, both dependent on weakness.
             // One is deterministic with weakness, and one is random with weakness.
             auto const value{
@@ -2,6 +2,8 @@
 
 #include "type.h"
 
+class ThreadPool;
+
 // MaxLevel should be <= MAX_PLY / 12
 constexpr uint16_t MaxLevel{ 20 };
 
@@ -10,7 +12,7 @@ class SkillManager final {
 
 public:
 
-    constexpr SkillManager() noexcept;
+    SkillManager() noexcept;
     SkillManager(SkillManager const&) = delete;
     SkillManager(SkillManager&&) = delete;
 
@@ -24,13 +26,10 @@ public:
 
     void clear() noexcept;
 
-    Move pickBestMove() noexcept;
+    Move pickBestMove(ThreadPool const&) noexcept;
 
 private:
 
     uint16_t level;
     Move bestMove;
 };
-
-// Global Skill Manager
-extern SkillManager SkillMgr;
@@ -4,19 +4,25 @@
 #include <cstdlib>
 #include <cstring> // For memset(), memcmp()
 #include <algorithm>
+#include <atomic>
 #include <deque>
 #include <fstream>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "bitboard.h"
 #include "movegenerator.h"
 #include "notation.h"
 #include "position.h"
+#include "session.h"
 #include "thread.h"
 #include "uci.h"
+#include "helper/memoryhandler.h"
 #include "helper/string.h"
 #include "helper/string_view.h"
 
@@ -33,6 +39,7 @@
     #undef NOMINMAX
     #undef WIN32_LEAN_AND_MEAN
 #else
+    #include <dirent.h>
     #include <fcntl.h>
     #include <unistd.h>
     #include <sys/mman.h>
@@ -160,35 +167,80 @@ namespace {
 
     // class TBFile memory maps/unmaps the single .rtbw and .rtbz files. Files are
     // memory mapped for best performance. Files are mapped at first access: at init
-    // time only existence of the file is checked.
-    class TBFile :
-        public std::ifstream {
+    // time only existence of the file is checked, against the index of the directories.
+    class TBFile {
 
     public:
-        // Look for and open the file among the Paths directories where the .rtbw and .rtbz files can be found.
+        // Look for the file among the Paths directories where the .rtbw and .rtbz files can be found.
         // Multiple directories are separated by ";" on Windows and by ":" on Unix-based operating systems.
         //
         // Example:
         // C:\tb\wdl345;C:\tb\wdl6;D:\tb\dtz345;D:\tb\dtz6
         static std::vector<std::string> Paths;
+        // Files found in the Paths directories, name -> full path (first directory wins)
+        static std::unordered_map<std::string, std::string> Files;
 
-        std::string filename;
+        // Key of a file name in Files, Windows file names are case-insensitive
+        static std::string fileKey(std::string const &name) {
+        #if defined(_WIN32)
+            return toLower(name);
+        #else
+            return name;
+        #endif
+        }
 
-        TBFile(std::string_view file) {
-            filename.clear();
-            for (auto &path : Paths) {
-                auto fname{ path + "/" + file.data() }; //appendPath(path, file);
-                std::ifstream::open(fname);
-                if (is_open()) {
-                    filename = fname;
-                    std::ifstream::close();
-                    return;
+        // List each directory once and index the table files found
+        static void scan() {
+            Files.clear();
+
+            auto const add{ [](std::string const &path, std::string const &name) {
+                auto const key{ fileKey(name) };
+                if (key.size() > 5
+                 && (key.compare(key.size() - 5, 5, ".rtbw") == 0
+                  || key.compare(key.size() - 5, 5, ".rtbz") == 0)) {
+                    Files.emplace(key, path + "/" + name);
+                }
+            } };
+
+            for (auto const &path : Paths) {
+
+            #if defined(_WIN32)
+
+                WIN32_FIND_DATAA findData;
+                HANDLE hFind = FindFirstFileA((path + "/*.rtb?").c_str(), &findData);
+                if (hFind == INVALID_HANDLE_VALUE) {
+                    continue;
+                }
+                do {
+                    add(path, findData.cFileName);
+                } while (FindNextFileA(hFind, &findData));
+                FindClose(hFind);
+
+            #else
+
+                DIR *dir = opendir(path.c_str());
+                if (dir == nullptr) {
+                    continue;
                 }
+                dirent const *entry;
+                while ((entry = readdir(dir)) != nullptr) {
+                    add(path, entry->d_name);
+                }
+                closedir(dir);
+
+            #endif
             }
         }
 
-        // Memory map the file and check it. File should be already open and will be closed after mapping.
-        uint8_t* map(void **baseAddress, uint64_t *mapping, TBType type) {
+        std::string filename;
+
+        TBFile(std::string const &file) {
+            auto const itr{ Files.find(fileKey(file)) };
+            filename = itr != Files.end() ? itr->second : std::string{};
+        }
+
+        // Memory map the file and check it.
+        uint8_t* map(void **baseAddress, uint64_t *mapping, uint64_t *size, TBType type) {
             assert(!filename.empty());
 
         #if defined(_WIN32)
@@ -220,6 +272,7 @@ namespace {
             }
 
             *mapping = (uint64_t)hFileMap;
+            *size = (uint64_t(hiSize) << 32) | loSize;
             *baseAddress = MapViewOfFile(hFileMap, FILE_MAP_READ, 0, 0, 0);
             if ((*baseAddress) == nullptr) {
                 std::cerr << "MapViewOfFile() failed, file = " << filename << '\n';
@@ -251,6 +304,7 @@ namespace {
             }
 
             *mapping = statbuf.st_size;
+            *size = statbuf.st_size;
             *baseAddress = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, hFile, 0);
 
             #if defined(MADV_RANDOM)
@@ -296,6 +350,7 @@ namespace {
     };
 
     std::vector<std::string> TBFile::Paths;
+    std::unordered_map<std::string, std::string> TBFile::Files;
 
     /// struct PairsData contains low level indexing information to access TB data.
     /// There are 8, 4 or 2 PairsData records for each TBTable, according to type of
@@ -333,9 +388,12 @@ namespace {
         static constexpr int16_t Sides{ Type == WDL ? 2 : 1 };
 
         std::atomic<bool> ready;
+        std::mutex mutex;       // Serializes the mapping of this table only
+        std::string code;       // Like "KRPvKR", white is the side of matlKey1
         void    *baseAddress;
         uint8_t *map;
         uint64_t mapping;
+        uint64_t size;          // Size of the mapped file
         Key     matlKey1;
         Key     matlKey2;
         int32_t pieceCount;
@@ -352,7 +410,8 @@ namespace {
             ready{ false },
             baseAddress{ nullptr },
             map{ nullptr },
-            mapping{ 0 } {
+            mapping{ 0 },
+            size{ 0 } {
         }
 
         explicit TBTable(std::string_view);
@@ -366,11 +425,12 @@ namespace {
     };
 
     template<>
-    TBTable<WDL>::TBTable(std::string_view code) :
+    TBTable<WDL>::TBTable(std::string_view tbCode) :
         TBTable{} {
 
         StateInfo si;
         Position pos;
+        code = tbCode;
         matlKey1 = pos.setup(code, WHITE, si).matlKey();
         pieceCount = pos.count();
         hasPawns = pos.count(PAWN) != 0;
@@ -402,6 +462,7 @@ namespace {
     TBTable<DTZ>::TBTable(TBTable<WDL> const &wdl) :
         TBTable{} {
 
+        code = wdl.code;
         matlKey1 = wdl.matlKey1;
         matlKey2 = wdl.matlKey2;
         pieceCount = wdl.pieceCount;
@@ -444,6 +505,9 @@ namespace {
             return wdlTable.size();
         }
 
+        template<TBType Type>
+        std::deque<TBTable<Type>>& tables() noexcept;
+
         void add(std::vector<PieceType> const &pieces) {
 
             std::ostringstream oss;
@@ -515,6 +579,11 @@ namespace {
         std::deque<TBTable<DTZ>> dtzTable;
     };
 
+    template<>
+    std::deque<TBTable<WDL>>& TBTableDB::tables<WDL>() noexcept { return wdlTable; }
+    template<>
+    std::deque<TBTable<DTZ>>& TBTableDB::tables<DTZ>() noexcept { return dtzTable; }
+
     TBTableDB TBTables;
 
     /// TB tables are compressed with canonical Huffman code. The compressed data is divided into
@@ -1238,13 +1307,12 @@ namespace {
         }
     }
 
-    // If the TB file corresponding to the given position is already memory mapped
-    // then return its base address, otherwise try to memory map and init it. Called
-    // at every probe, memory map and init only at first access. Function is thread
-    // safe and can be called concurrently.
+    // If the TB file of the table is already memory mapped then return its base address,
+    // otherwise try to memory map and init it. Called at every probe, memory map and init
+    // only at first access. Function is thread safe and can be called concurrently,
+    // only the threads needing the same table wait for each other.
     template<TBType Type>
-    void* mapped(TBTable<Type> &e, Position const &pos) {
-        static std::mutex mutex;
+    void* mapped(TBTable<Type> &e) {
 
         // Use 'acquire' to avoid a thread reading 'ready' == true while
         // another is still working. (compiler reordering may cause this).
@@ -1252,30 +1320,157 @@ namespace {
             return e.baseAddress; // Could be nullptr if file does not exist
         }
 
-        std::lock_guard<std::mutex> lockGuard(mutex);
+        std::lock_guard<std::mutex> lockGuard(e.mutex);
 
         if (e.ready.load(std::memory_order::memory_order_relaxed)) { // Recheck under lock
             return e.baseAddress;
         }
 
-        // Pieces strings in decreasing order for each color, like ("KPP","KR")
-        std::string w, b;
-        for (PieceType pt = KING; pt >= PAWN; --pt) {
-            w += std::string(pos.count(WHITE|pt), toChar(pt));
-            b += std::string(pos.count(BLACK|pt), toChar(pt));
-        }
-
-        std::string code{ pos.matlKey() == e.matlKey1 ? w + 'v' + b : b + 'v' + w };
-
-        uint8_t *data{ TBFile{ code + (Type == WDL ? ".rtbw" : ".rtbz") }.map(&e.baseAddress, &e.mapping, Type) };
-        if (data != nullptr) {
-            set(e, data);
+        TBFile file{ e.code + (Type == WDL ? ".rtbw" : ".rtbz") };
+        if (!file.filename.empty()) {
+            uint8_t *data{ file.map(&e.baseAddress, &e.mapping, &e.size, Type) };
+            if (data != nullptr) {
+                set(e, data);
+            }
         }
 
         e.ready.store(true, std::memory_order::memory_order_release);
         return e.baseAddress;
     }
 
+    /// TBLoader maps and preloads the tables on a background thread, so that
+    /// the search threads do not pay for the mapping and the disk reads at first access.
+    ///  - premap maps all the tables.
+    ///  - preload warms the page cache of the WDL (or all) tables, and locks them in memory
+    ///    while they fit the lock limit.
+    class TBLoader {
+
+    public:
+        enum Preload : uint8_t { PL_NONE, PL_WDL, PL_ALL };
+
+        ~TBLoader() {
+            stop();
+        }
+
+        void start(bool premap, Preload preload, uint64_t lockLimit) {
+            stop();
+            abort = false;
+            thread = std::thread{ [this, premap, preload, lockLimit]() { run(premap, preload, lockLimit); } };
+        }
+
+        void stop() {
+            abort = true;
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+
+    private:
+
+        template<TBType Type>
+        uint32_t premap(uint64_t &totalSize) {
+            uint32_t count{ 0 };
+            for (auto &e : TBTables.tables<Type>()) {
+                if (abort) {
+                    break;
+                }
+                if (mapped(e) != nullptr) {
+                    ++count;
+                    totalSize += e.size;
+                }
+            }
+            return count;
+        }
+
+        template<TBType Type>
+        void preload(uint64_t totalSize, uint64_t lockLimit, uint64_t &loadSize, uint64_t &lockSize) {
+            constexpr uint64_t PageSize{ 4096 };
+
+            for (auto &e : TBTables.tables<Type>()) {
+                if (abort) {
+                    break;
+                }
+                if (e.baseAddress == nullptr) {
+                    continue;
+                }
+
+                bool locked{ false };
+                if (lockSize + e.size <= lockLimit) {
+            #if defined(_WIN32)
+                    locked = VirtualLock(e.baseAddress, e.size) != 0;
+            #else
+                    locked = mlock(e.baseAddress, e.size) == 0;
+            #endif
+                    lockSize += locked ? e.size : 0;
+                }
+                if (!locked) {
+            #if !defined(_WIN32) && defined(MADV_WILLNEED)
+                    madvise(e.baseAddress, e.size, MADV_WILLNEED);
+            #endif
+                    // Touch every page so that the file is in the page cache once done
+                    auto const *data{ static_cast<uint8_t const volatile*>(e.baseAddress) };
+                    uint8_t sum{ 0 };
+                    for (uint64_t offset = 0; offset < e.size; offset += PageSize) {
+                        sum += data[offset];
+                    }
+                    (void)sum;
+                }
+
+                // Report progress at every 10%
+                auto const decile{ (loadSize * 10) / totalSize };
+                loadSize += e.size;
+                if ((loadSize * 10) / totalSize != decile) {
+                    sync_cout << "info string Tablebases preloading "
+                              << (loadSize * 100) / totalSize << "% "
+                              << (loadSize >> 20) << " of " << (totalSize >> 20) << " MB" << sync_endl;
+                }
+            }
+        }
+
+        void run(bool premapAll, Preload preloadKind, uint64_t lockLimit) {
+            auto const startTime{ now() };
+
+            uint64_t wdlSize{ 0 },
+                     dtzSize{ 0 };
+            auto const wdlCount{ premap<WDL>(wdlSize) };
+            auto const dtzCount{ premapAll
+                              || preloadKind == PL_ALL ? premap<DTZ>(dtzSize) : 0 };
+            if (abort) {
+                return;
+            }
+            if (premapAll) {
+                sync_cout << "info string Tablebases premapped"
+                          << " WDL " << wdlCount
+                          << " DTZ " << dtzCount
+                          << " time " << now() - startTime << sync_endl;
+            }
+
+            if (preloadKind == PL_NONE
+             || wdlSize == 0) {
+                return;
+            }
+            auto const totalSize{ wdlSize + (preloadKind == PL_ALL ? dtzSize : 0) };
+            uint64_t loadSize{ 0 },
+                     lockSize{ 0 };
+            preload<WDL>(totalSize, lockLimit, loadSize, lockSize);
+            if (preloadKind == PL_ALL) {
+                preload<DTZ>(totalSize, lockLimit, loadSize, lockSize);
+            }
+            if (abort) {
+                return;
+            }
+            sync_cout << "info string Tablebases preloaded "
+                      << (loadSize >> 20) << " MB"
+                      << " locked " << (lockSize >> 20) << " MB"
+                      << " time " << now() - startTime << sync_endl;
+        }
+
+        std::thread thread;
+        std::atomic<bool> abort{ false };
+    };
+
+    TBLoader Loader;
+
     template<TBType Type, typename Ret = typename TBTable<Type>::Ret>
     Ret probeTable(Position const &pos, ProbeState &state, WDLScore wdl = WDL_DRAW) {
 
@@ -1289,7 +1484,7 @@ namespace {
         TBTable<Type> *entry{ TBTables.get<Type>(pos.matlKey()) };
 
         if (entry == nullptr
-         || mapped(*entry, pos) == nullptr) {
+         || mapped(*entry) == nullptr) {
             state = PS_FAILURE;
             return Ret();
         }
@@ -1310,6 +1505,8 @@ namespace {
     /// (winning capture or winning pawn move). Also DTZ store wrong values for positions
     /// where the best move is an ep-move(even if losing). So in all these cases set
     /// the state to PS_ZEROING.
+    WDLScore cachedSearch(Position&, ProbeState&);
+
     WDLScore search(Position &pos, ProbeState &state, bool checkZeroing) {
 
         WDLScore wdlBestScore{ WDL_LOSS };
@@ -1328,7 +1525,7 @@ namespace {
             ++moveCount;
 
             pos.doMove(move, si);
-            wdlScore = -search(pos, state, false);
+            wdlScore = -cachedSearch(pos, state);
             pos.undoMove(move);
 
             if (state == PS_FAILURE) {
@@ -1376,10 +1573,71 @@ namespace {
         return wdlScore;
     }
 
+    /// cachedSearch() is search() without zeroing check, looked up first in the probe cache of the thread.
+    /// Only the successful probes are saved, failure depends on the tables available.
+    WDLScore cachedSearch(Position &pos, ProbeState &state) {
+        auto *const th{ pos.thread() };
+        if (th == nullptr) {
+            return search(pos, state, false);
+        }
+
+        WDLScore wdlScore;
+        if (th->tbCache.probe(pos.posiKey(), wdlScore, state)) {
+            return wdlScore;
+        }
+        wdlScore = search(pos, state, false);
+        if (state != PS_FAILURE) {
+            th->tbCache.save(pos.posiKey(), wdlScore, state);
+        }
+        return wdlScore;
+    }
+
 }
 
 namespace SyzygyTB {
 
+    /// ProbeCache::resize() sets the size of the cache, measured in KB (0 disables it)
+    void ProbeCache::resize(uint32_t memSize) {
+        uint64_t entryCount{ (uint64_t(memSize) << 10) / sizeof (uint64_t) };
+        // Round down to power of 2
+        while ((entryCount & (entryCount - 1)) != 0) {
+            entryCount &= entryCount - 1;
+        }
+        table.assign(entryCount, 0);
+        table.shrink_to_fit();
+        mask = entryCount != 0 ? entryCount - 1 : 0;
+        hits = probes = 0;
+    }
+
+    void ProbeCache::clear() noexcept {
+        std::fill(table.begin(), table.end(), 0);
+    }
+
+    bool ProbeCache::probe(Key key, WDLScore &wdlScore, ProbeState &state) noexcept {
+        if (table.empty()) {
+            return false;
+        }
+        ++probes;
+        auto const data{ table[key & mask] };
+        if (data == 0
+         || ((data ^ key) >> 16) != 0) {
+            return false;
+        }
+        ++hits;
+        wdlScore = WDLScore(int32_t((data >> 8) & 0xFF) - 2);
+        state = ProbeState(int32_t(data & 0xFF) - 2);
+        return true;
+    }
+
+    void ProbeCache::save(Key key, WDLScore wdlScore, ProbeState state) noexcept {
+        if (table.empty()) {
+            return;
+        }
+        table[key & mask] = (key & ~U64(0xFFFF))
+                          | (uint64_t(wdlScore + 2) << 8)
+                          | uint64_t(state + 2);
+    }
+
     WDLScore operator-(WDLScore wdl) { return WDLScore(-int32_t(wdl)); }
 
     std::ostream& operator<<(std::ostream &ostream, WDLScore wdlScore) {
@@ -1414,7 +1672,7 @@ namespace SyzygyTB {
     WDLScore probeWDL(Position &pos, ProbeState &state) {
 
         state = PS_SUCCESS;
-        return search(pos, state, false);
+        return cachedSearch(pos, state);
     }
 
     /// Probe the DTZ table for a particular position.
@@ -1488,7 +1746,7 @@ namespace SyzygyTB {
             // position after the move to get the score sign(because even in a
             // winning position we could make a losing capture or going for a draw).
             dtz = zeroing ?
-                    -beforeZeroingDTZ(search(pos, state, false)) :
+                    -beforeZeroingDTZ(cachedSearch(pos, state)) :
                     -probeDTZ(pos, state);
 
             // If the move mates, force minDTZ to 1
@@ -1537,6 +1795,58 @@ namespace SyzygyTB {
         +VALUE_MATE_1_MAX_PLY - 1
     };
 
+    /// Rank the root moves in parallel on the idle search threads.
+    /// Each worker probes its share of moves on its own copy of the root position.
+    ///
+    /// A return value false indicates that not all probes were successful.
+    template<typename Rank>
+    bool rankParallel(Position &rootPos, RootMoves &rootMoves, Rank rank) {
+
+        auto const &threadpool{ rootPos.thread()->session.threadpool };
+        auto const threadCount{ uint16_t(std::min(threadpool.size(), rootMoves.size())) };
+        if (threadCount <= 1) {
+            for (auto &rm : rootMoves) {
+                if (!rank(rootPos, rm)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        auto const fen{ rootPos.fen() };
+        std::atomic<size_t> moveIndex{ 0 };
+        std::atomic<bool> failed{ false };
+
+        auto *const session{ CurrentSession };
+        std::vector<std::thread> threads;
+        for (uint16_t index = 0; index < threadCount; ++index) {
+            threads.emplace_back(
+                [&, threadCount, index]() {
+
+                    if (threadCount > 8) {
+                        WinProcGroup::bind(index);
+                    }
+                    CurrentSession = session;
+                    Position pos;
+                    StateInfo si;
+                    pos.setup(fen, si, threadpool[index]);
+
+                    for (auto i{ moveIndex.fetch_add(1, std::memory_order::memory_order_relaxed) };
+                         i < rootMoves.size()
+                      && !failed.load(std::memory_order::memory_order_relaxed);
+                         i = moveIndex.fetch_add(1, std::memory_order::memory_order_relaxed)) {
+                        if (!rank(pos, rootMoves[i])) {
+                            failed.store(true, std::memory_order::memory_order_relaxed);
+                        }
+                    }
+                });
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+        return !failed;
+    }
+
     /// Use the WDL tables to filter out moves that don't preserve the win or draw.
     /// This is a fall back for the case that some or all DTZ tables are missing.
     ///
@@ -1544,18 +1854,19 @@ namespace SyzygyTB {
     /// no moves were filtered out.
     bool rootProbeWDL(Position &rootPos, RootMoves &rootMoves) {
 
-        bool move50Rule{ Options["SyzygyMove50Rule"] };
+        bool const move50Rule{ Options["SyzygyMove50Rule"] };
 
-        StateInfo si;
-        ProbeState state;
         // Probe and rank each move
-        for (auto &rm : rootMoves) {
-            auto move = rm[0];
-            rootPos.doMove(move, si);
+        return rankParallel(rootPos, rootMoves, [&](Position &pos, RootMove &rm) {
+            StateInfo si;
+            ProbeState state;
+
+            auto move{ rm[0] };
+            pos.doMove(move, si);
 
-            WDLScore wdl{ -probeWDL(rootPos, state) };
+            WDLScore wdl{ -probeWDL(pos, state) };
 
-            rootPos.undoMove(move);
+            pos.undoMove(move);
 
             if (state == PS_FAILURE) {
                 return false;
@@ -1568,8 +1879,8 @@ namespace SyzygyTB {
                       wdl < WDL_DRAW ? WDL_LOSS : WDL_DRAW;
             }
             rm.tbValue = wdlToValue[wdl + 2];
-        }
-        return true;
+            return true;
+        });
     }
 
     /// Use the DTZ tables to rank root moves.
@@ -1579,39 +1890,40 @@ namespace SyzygyTB {
         assert(rootMoves.size() != 0);
 
         // Obtain 50-move counter for the root position
-        auto clockPly{ rootPos.clockPly() };
+        auto const clockPly{ rootPos.clockPly() };
         // Check whether a position was repeated since the last zeroing move.
-        bool repeated{ rootPos.repeated() };
+        bool const repeated{ rootPos.repeated() };
 
-        int16_t bound{ int16_t(Options["SyzygyMove50Rule"] ? 900 : 1) };
-        int32_t dtz;
+        int16_t const bound{ int16_t(Options["SyzygyMove50Rule"] ? 900 : 1) };
 
-        StateInfo si;
-        ProbeState state;
         // Probe and rank each move
-        for (auto &rm : rootMoves) {
+        return rankParallel(rootPos, rootMoves, [&](Position &pos, RootMove &rm) {
+            StateInfo si;
+            ProbeState state;
+            int32_t dtz;
+
             auto move{ rm[0] };
-            rootPos.doMove(move, si);
+            pos.doMove(move, si);
 
             // Calculate dtz for the current move counting from the root position
-            if (rootPos.clockPly() == 0) {
+            if (pos.clockPly() == 0) {
                 // In case of a zeroing move, dtz is one of -101/-1/0/+1/+101
-                dtz = beforeZeroingDTZ(-probeWDL(rootPos, state));
+                dtz = beforeZeroingDTZ(-probeWDL(pos, state));
             }
             else {
                 // Otherwise, take dtz for the new position and correct by 1 ply
-                dtz = -probeDTZ(rootPos, state);
+                dtz = -probeDTZ(pos, state);
                 dtz = dtz > 0 ? dtz + 1 :
                       dtz < 0 ? dtz - 1 : dtz;
             }
             // Make sure that a mating move is assigned a dtz value of 1
-            if (rootPos.checkers() != 0
+            if (pos.checkers() != 0
              && dtz == 2
-             && MoveList<LEGAL>(rootPos).size() == 0) {
+             && MoveList<LEGAL>(pos).size() == 0) {
                 dtz = 1;
             }
 
-            rootPos.undoMove(move);
+            pos.undoMove(move);
 
             if (state == PS_FAILURE) {
                 return false;
@@ -1633,8 +1945,8 @@ namespace SyzygyTB {
                 r == 0      ?  VALUE_DRAW :
                 r > -bound  ? (VALUE_EG_PAWN * std::min(-3, r + 800)) / 200 :
                               -VALUE_MATE_1_MAX_PLY + 1;
-        }
-        return true;
+            return true;
+        });
     }
 
     void initialize(std::string_view paths) noexcept {
@@ -1758,7 +2070,11 @@ namespace SyzygyTB {
             initialized = true;
         }
 
+        // Tables are going to be destroyed
+        Loader.stop();
+
         TBTables.clear();
+        TBFile::Files.clear();
         MaxPieceLimit = 0;
 
         if (whiteSpaces(paths)) {
@@ -1775,8 +2091,11 @@ namespace SyzygyTB {
         constexpr char Delimiter{ ':' };
     #endif
 
+        auto const startTime{ now() };
+
         // Split paths by delimiter
         TBFile::Paths = split(paths, Delimiter);
+        TBFile::scan();
 
         for (PieceType p1 = PAWN; p1 <= QUEN; ++p1) {
             TBTables.add({ KING, p1, KING });
@@ -1817,6 +2136,24 @@ namespace SyzygyTB {
             }
         }
 
-        sync_cout << "info string Tablebases found " << TBTables.size() << sync_endl;
+        sync_cout << "info string Tablebases found " << TBTables.size()
+                  << " in " << now() - startTime << " ms" << sync_endl;
+
+        restartLoader();
+    }
+
+    /// restartLoader() stops the background premap/preload of the tables and starts it again
+    /// with the current SyzygyPremap, SyzygyPreload and SyzygyLockLimit options.
+    /// The tables stay mapped, those already in the page cache are only touched again.
+    void restartLoader() noexcept {
+        Loader.stop();
+
+        auto const preload{ Options["SyzygyPreload"] == "WDL" ? TBLoader::PL_WDL :
+                            Options["SyzygyPreload"] == "All" ? TBLoader::PL_ALL : TBLoader::PL_NONE };
+        if (TBTables.size() != 0
+         && (Options["SyzygyPremap"]
+          || preload != TBLoader::PL_NONE)) {
+            Loader.start(Options["SyzygyPremap"], preload, uint64_t(Options["SyzygyLockLimit"]) << 20);
+        }
     }
 }
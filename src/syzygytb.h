@@ -3,6 +3,7 @@
 #include <iostream>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "position.h"
 #include "rootmove.h"
@@ -37,6 +38,27 @@ namespace SyzygyTB {
 
     extern int16_t MaxPieceLimit;
 
+    /// ProbeCache is a small per-thread hash of the recent WDL probe results,
+    /// the same endgame positions are reached again through transpositions
+    /// and through the capture resolution of the probe itself.
+    /// Each entry packs the upper 48 bits of the key with the score and the state.
+    class ProbeCache {
+
+    public:
+        void resize(uint32_t);
+        void clear() noexcept;
+
+        bool probe(Key, WDLScore&, ProbeState&) noexcept;
+        void save(Key, WDLScore, ProbeState) noexcept;
+
+        uint64_t hits{ 0 };
+        uint64_t probes{ 0 };
+
+    private:
+        std::vector<uint64_t> table;
+        uint64_t mask{ 0 };
+    };
+
     extern WDLScore probeWDL(Position&, ProbeState&);
     extern int32_t  probeDTZ(Position&, ProbeState&);
 
@@ -46,5 +68,6 @@ namespace SyzygyTB {
     extern void rankRootMoves(Position&, RootMoves&);
 
     extern void initialize(std::string_view) noexcept;
+    extern void restartLoader() noexcept;
 
 }
@@ -1,27 +1,51 @@
 #include "thread.h"
 
 #include <cassert>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
+#include <thread>
 #include <unordered_map>
 
 #include "searcher.h"
+#include "session.h"
 #include "syzygytb.h"
 #include "transposition.h"
 #include "uci.h"
 #include "helper/memoryhandler.h"
 
-ThreadPool Threadpool;
+namespace {
+
+    /// spin() yields until the condition holds or the given microseconds elapse,
+    /// returns whether the condition holds.
+    template<typename Pred>
+    bool spin(uint32_t spinWait, Pred pred) {
+        if (spinWait == 0) {
+            return false;
+        }
+        auto const spinEnd{ std::chrono::steady_clock::now() + std::chrono::microseconds(spinWait) };
+        while (!pred()) {
+            if (std::chrono::steady_clock::now() >= spinEnd) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+}
 
 /// Thread constructor launches the thread and waits until it goes to sleep in threadFunc().
 /// Note that 'busy' and 'dead' should be already set.
-Thread::Thread(uint16_t idx) :
+Thread::Thread(Session &s, uint16_t idx) :
+    session{ s },
     dead{ false },
     busy{ true },
     index(idx),
     nativeThread(&Thread::threadFunc, this) {
 
     waitIdle();
+    tbCache.resize(Options["SyzygyProbeCache"]);
 }
 /// Thread destructor wakes up the thread in threadFunc() and waits for its termination.
 /// Thread should be already waiting.
@@ -38,14 +62,27 @@ void Thread::wakeUp() {
     conditionVar.notify_one(); // Wake up the thread in threadFunc()
 }
 /// Thread::waitIdle() blocks on the condition variable while the thread is busy.
+/// With 'Spin Wait' it first spins a while, a thread about to finish is seen without sleeping.
 void Thread::waitIdle() {
+    if (spin(session.threadpool.spinWait.load(std::memory_order::memory_order_relaxed), [&]{ return !busy.load(std::memory_order::memory_order_acquire); })) {
+        // Synchronize with the thread, it may still hold the lock after clearing busy
+        std::lock_guard<std::mutex> lockGuard(mutex);
+        return;
+    }
     std::unique_lock<std::mutex> uniqueLock(mutex);
-    conditionVar.wait(uniqueLock, [&]{ return !busy; });
+    conditionVar.wait(uniqueLock, [&]{ return !busy.load(); });
     //uniqueLock.unlock();
 }
+/// Thread::idle() checks whether the thread waits for work in threadFunc().
+bool Thread::idle() const noexcept {
+    return !busy.load(std::memory_order::memory_order_acquire);
+}
 /// Thread::threadFunc() is where the thread is parked.
 /// Blocked on the condition variable, when it has no work to do.
+/// With 'Spin Wait' it first spins a while, a search started meanwhile is picked up without a kernel wake up.
 void Thread::threadFunc() {
+    CurrentSession = &session;
+
     // If OS already scheduled us on a different group than 0 then don't overwrite
     // the choice, eventually we are one of many one-threaded processes running on
     // some Windows NUMA hardware, for instance in fishtest. To make it simple,
@@ -56,16 +93,26 @@ void Thread::threadFunc() {
     }
 
     while (true) {
+        // Read before going idle, once idle the pool may set up the next search
+        auto const spinWait{ session.threadpool.spinWait.load(std::memory_order::memory_order_relaxed) };
 
         std::unique_lock<std::mutex> uniqueLock(mutex);
         busy = false;
         conditionVar.notify_one(); // Wake up anyone waiting for search finished
-        conditionVar.wait(uniqueLock, [&]{ return busy; });
+        if (spinWait != 0) {
+            uniqueLock.unlock();
+            spin(spinWait, [&]{ return busy.load(std::memory_order::memory_order_acquire); });
+            uniqueLock.lock();
+        }
+        conditionVar.wait(uniqueLock, [&]{ return busy.load(); });
         if (dead) {
             return;
         }
         uniqueLock.unlock();
 
+        if (session.threadpool.hardwareCounters) {
+            perfCounters.open();
+        }
         search();
     }
 }
@@ -88,17 +135,23 @@ void Thread::clean() {
     //kingHash.clear();
     //matlHash.clear();
     //pawnHash.clear();
+    tbCache.clear();
 }
 
 /// MainThread::clean()
 void MainThread::clean() {
     Thread::clean();
 
+    tickCount = 0;
     bestValue = +VALUE_INFINITE;
     timeReduction = 1.00;
     iterValues.fill(VALUE_ZERO);
 }
 
+ThreadPool::ThreadPool(Session &s) noexcept :
+    session{ s } {
+}
+
 ThreadPool::~ThreadPool() {
     setup(0);
 }
@@ -107,6 +160,12 @@ MainThread* ThreadPool::mainThread() const noexcept {
     return static_cast<MainThread*>(front());
 }
 
+/// ThreadPool::searching() checks whether a search is running (or the threads are being set up).
+bool ThreadPool::searching() const noexcept {
+    return !empty()
+        && !mainThread()->idle();
+}
+
 Thread* ThreadPool::bestThread() const noexcept {
     Thread *bestTh{ front() };
 
@@ -153,7 +212,8 @@ Thread* ThreadPool::bestThread() const noexcept {
 /// ThreadPool::setSize() creates/destroys threads to match the threadCount.
 /// Created and launched threads will immediately go to sleep in threadFunc.
 /// Upon resizing, threads are recreated to allow for binding if necessary.
-void ThreadPool::setup(uint16_t threadCount) {
+/// The hash is reallocated with the given size (MB), zero means the Hash option.
+void ThreadPool::setup(uint16_t threadCount, uint32_t hash) {
     stop = true;
     if (!empty()) {
         mainThread()->waitIdle();
@@ -165,18 +225,41 @@ void ThreadPool::setup(uint16_t threadCount) {
     // Create new thread(s)
     if (threadCount != 0) {
 
-        push_back(new MainThread(size()));
+        push_back(new MainThread(session, size()));
         while (size() < threadCount) {
-            push_back(new Thread(size()));
+            push_back(new Thread(session, size()));
         }
 
         clean();
         // Reallocate the hash with the new threadpool size
-        uint32_t hash{ Options["Hash"] };
-        TT.autoResize(hash);
-        TTEx.autoResize(hash / 4);
-        Searcher::initialize();
+        if (hash == 0) {
+            hash = Options["Hash"];
+        }
+        session.tt.autoResize(hash);
+        session.ttEx.autoResize(hash / 4);
+        Searcher::initialize(reductions, threadCount);
     }
+    nodeSamples.assign(size(), 0);
+    nodeSampleSum = 0;
+    nodeSampleIndex = 0;
+}
+
+/// ThreadPool::sampleNodes() returns the nodes searched by all the threads, as last read.
+/// Each call reads only NodeSampleBatch threads (round-robin), so the cost per call is bounded
+/// whatever the number of threads, the sum lags behind by at most size() / NodeSampleBatch calls.
+/// With less threads than the batch the sum is exact. Only the main thread should call it while searching.
+uint64_t ThreadPool::sampleNodes() noexcept {
+
+    for (uint16_t i = 0; i < std::min(uint16_t(size()), NodeSampleBatch); ++i) {
+        if (nodeSampleIndex >= size()) {
+            nodeSampleIndex = 0;
+        }
+        auto const nodeCount{ (*this)[nodeSampleIndex]->nodes.load(std::memory_order::memory_order_relaxed) };
+        nodeSampleSum += nodeCount - nodeSamples[nodeSampleIndex];
+        nodeSamples[nodeSampleIndex] = nodeCount;
+        ++nodeSampleIndex;
+    }
+    return nodeSampleSum;
 }
 
 /// ThreadPool::clean() clears all the threads in threadpool
@@ -193,10 +276,12 @@ void ThreadPool::startThinking(Position &pos, StateListPtr &states) {
 
     stop = false;
     stand = false;
+    spinWait.store(Options["Spin Wait"], std::memory_order::memory_order_relaxed);
+    deterministic = Options["Deterministic"];
 
     mainThread()->stopPonderhit = false;
 
-    RootMoves rootMoves{ pos, Limits.searchMoves };
+    RootMoves rootMoves{ pos, session.limits.searchMoves };
 
     if (!rootMoves.empty()) {
         SyzygyTB::rankRootMoves(pos, rootMoves);
@@ -211,27 +296,85 @@ void ThreadPool::startThinking(Position &pos, StateListPtr &states) {
         setupStates = std::move(states); // Ownership transfer, states is now empty
     }
 
-    // We use setup() to set root position across threads.
-    // But there are some StateInfo fields (previous, nullPly, captured) that cannot be deduced
-    // from a fen string, so setup() clears them and they are set from setupStates->back() later.
-    // The rootState is per thread, earlier states are shared since they are read-only.
-    auto const fen{ pos.fen() };
+    nodeSamples.assign(size(), 0);
+    nodeSampleSum = 0;
+    nodeSampleIndex = 0;
+
+    // The root position is copied to every thread together with its state (previous, nullPly, captured ...),
+    // the rootState is per thread, earlier states are shared since they are read-only.
+    assert(pos.state() == &setupStates->back());
     for (auto *th : *this) {
         th->rootDepth     = DEPTH_ZERO;
         th->finishedDepth = DEPTH_ZERO;
         th->nodes         = 0;
         th->tbHits        = 0;
+        th->tbCache.hits   = 0;
+        th->tbCache.probes = 0;
         th->pvChanges     = 0;
         th->nmpMinPly     = 0;
         th->nmpColor      = COLORS;
         th->rootMoves     = rootMoves;
-        th->rootPos.setup(fen, th->rootState, th);
-        th->rootState     = setupStates->back();
+        th->rootPos.setup(pos, th->rootState, th);
+        th->turnNodes     = deterministic ? TurnQuantum : 0;
     }
 
+    // Main thread takes the first turn
+    turnThread = mainThread();
+    turnActive.assign(size(), true);
+
     mainThread()->wakeUp();
 }
 
+/// ThreadPool::releaseStates() gives back the setup states taken over by startThinking(),
+/// so that the next position can extend them.
+/// Nothing is given back until the main thread is idle: the root state of a search still finishing
+/// (after stop) links into them, so they must not be freed by a position that does not extend them.
+StateListPtr ThreadPool::releaseStates() noexcept {
+    if (searching()) {
+        return StateListPtr{};
+    }
+    return std::move(setupStates);
+}
+
+/// In deterministic mode the threads search one at a time in thread order, each for a quantum of nodes,
+/// so the shared state (transposition table, node counts, stop) changes in the same order on every run.
+/// ThreadPool::waitTurn() blocks the thread until it is in turn.
+void ThreadPool::waitTurn(Thread const *th) {
+    std::unique_lock<std::mutex> uniqueLock(turnMutex);
+    turnCondVar.wait(uniqueLock, [&]{ return turnThread == th; });
+}
+/// ThreadPool::passTurn() hands the turn to the next searching thread and waits for the next turn.
+void ThreadPool::passTurn(Thread const *th) {
+    std::unique_lock<std::mutex> uniqueLock(turnMutex);
+    auto const idx{ size_t(std::find(begin(), end(), th) - begin()) };
+    for (size_t i = 1; i <= size(); ++i) {
+        auto const next{ (idx + i) % size() };
+        if (turnActive[next]) {
+            turnThread = (*this)[next];
+            break;
+        }
+    }
+    if (turnThread != th) {
+        turnCondVar.notify_all();
+        turnCondVar.wait(uniqueLock, [&]{ return turnThread == th; });
+    }
+}
+/// ThreadPool::leaveTurns() removes the finished thread from the turns.
+void ThreadPool::leaveTurns(Thread const *th) {
+    std::lock_guard<std::mutex> lockGuard(turnMutex);
+    auto const idx{ size_t(std::find(begin(), end(), th) - begin()) };
+    turnActive[idx] = false;
+    turnThread = nullptr;
+    for (size_t i = 1; i < size(); ++i) {
+        auto const next{ (idx + i) % size() };
+        if (turnActive[next]) {
+            turnThread = (*this)[next];
+            break;
+        }
+    }
+    turnCondVar.notify_all();
+}
+
 void ThreadPool::wakeUpThreads() {
     for (auto *th : *this) {
         if (th != front()) {
@@ -247,13 +390,14 @@ void ThreadPool::waitForThreads() {
     }
 }
 
-/// Used to serialize access to std::cout to avoid multiple threads writing at the same time.
+/// Used to serialize writers of the output to avoid multiple threads writing at the same time.
 std::ostream& operator<<(std::ostream &ostream, OutputState outputState) {
     static std::mutex mutex;
 
     switch (outputState) {
     case OS_LOCK:
         mutex.lock();
+        OutputBuffer.prefix(CurrentSession->outputPrefix);
         break;
     case OS_UNLOCK:
         mutex.unlock();
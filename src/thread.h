@@ -14,7 +14,15 @@
 #include "king.h"
 #include "material.h"
 #include "pawns.h"
+#include "searcher.h"
+#include "searchstats.h"
+#include "syzygytb.h"
 #include "type.h"
+#include "helper/asyncstreambuffer.h"
+#include "helper/memoryhandler.h"
+#include "helper/perfcounters.h"
+
+class Session;
 
 /// Thread class keeps together all the thread-related stuff.
 /// It use pawn and material hash tables so that once get a pointer to
@@ -24,7 +32,7 @@ class Thread {
 
 public:
 
-    explicit Thread(uint16_t);
+    Thread(Session&, uint16_t);
 
     Thread() = delete;
     Thread(Thread const&) = delete;
@@ -37,12 +45,14 @@ public:
 
     void wakeUp();
     void waitIdle();
+    bool idle() const noexcept;
 
     void threadFunc();
 
     virtual void clean();
     virtual void search();
 
+    Session &session; // Session served by the thread
 
     Position  rootPos;
     StateInfo rootState;
@@ -52,11 +62,13 @@ public:
           finishedDepth,
           selDepth;
 
-    std::atomic<uint64_t> nodes;
+    // Counters are written by the thread all the time and read by the main thread,
+    // keep them on a cache line of their own so that the hot fields around are not invalidated
+    alignas(CacheLineSize) std::atomic<uint64_t> nodes;
     std::atomic<uint64_t> tbHits;
     std::atomic<uint32_t> pvChanges;
 
-    int16_t nmpMinPly;
+    alignas(CacheLineSize) int16_t nmpMinPly;
     Color   nmpColor;
 
     uint16_t pvBeg,
@@ -65,6 +77,15 @@ public:
 
     uint64_t ttHitAvg;
 
+    int16_t turnNodes; // Nodes left in the turn of a deterministic search, zero otherwise
+
+#if defined(SEARCH_STATS)
+    SearchStats::Table searchStats{};
+#endif
+
+    // Hardware counters of the thread, opened by the thread itself on demand
+    PerfCounters perfCounters;
+
     Score contempt;
 
     // butterFlyStats records how often quiet moves have been successful/unsuccessful
@@ -90,10 +111,18 @@ public:
     Pawns   ::Table pawnHash;
     King    ::Table kingHash;
 
+    SyzygyTB::ProbeCache tbCache;
+
+    // NNUE accumulator stack, indexed by ply (even slots for moves, odd slots for null moves).
+    // Kept out of StateInfo so that do/undo move touches only a couple of cache lines.
+    static constexpr uint16_t AccumulatorSlots{ 512 };
+    static_assert (AccumulatorSlots >= 2 * MAX_PLY, "AccumulatorSlots too small");
+    Evaluator::NNUE::Accumulator accumulators[AccumulatorSlots];
+
 private:
 
     bool dead;
-    bool busy;
+    std::atomic<bool> busy;
     std::mutex mutex;
     std::condition_variable conditionVar;
     uint16_t index; // indentity
@@ -144,7 +173,8 @@ public:
 
     //using std::vector<Thread*>::vector;
 
-    ThreadPool() = default;
+    explicit ThreadPool(Session&) noexcept;
+    ThreadPool() = delete;
     ~ThreadPool();
 
     ThreadPool(ThreadPool const&) = delete;
@@ -170,25 +200,60 @@ public:
     MainThread* mainThread() const noexcept;
     Thread* bestThread() const noexcept;
 
-    void setup(uint16_t);
+    bool searching() const noexcept;
+
+    uint64_t sampleNodes() noexcept;
+
+    void setup(uint16_t, uint32_t = 0);
     void clean();
 
     void startThinking(Position&, StateListPtr&);
+    StateListPtr releaseStates() noexcept;
 
     void wakeUpThreads();
     void waitForThreads();
 
+    void waitTurn(Thread const*);
+    void passTurn(Thread const*);
+    void leaveTurns(Thread const*);
+
+    static constexpr int16_t TurnQuantum{ 1024 };
+    static constexpr uint16_t NodeSampleBatch{ 16 };
+
     std::atomic<bool> stop;     // Stop searching forcefully
     std::atomic<bool> stand;    // Stop increasing depth
     uint16_t pvCount;
+    bool quiet{ false };        // Search without output (no info, no bestmove)
+    bool deterministic{ false };// Threads take turns, for reproducible multi-threaded searches
+    bool hardwareCounters{ false }; // Threads open their hardware counters before searching
+    // Microseconds an idle thread spins before it parks on the condition variable, read by the idle threads while set
+    std::atomic<uint32_t> spinWait{ 0 };
+
+    Searcher::ReductionTable reductions; // Set up for the thread count of the pool
+
+    // Tablebase probing of the current search, set up by SyzygyTB::rankRootMoves()
+    Depth   tbDepthLimit;
+    int16_t tbPieceLimit;
+    bool    tbMove50Rule;
+    bool    tbHasRoot;
 
 private:
 
+    Session &session;
+
     StateListPtr setupStates;
-};
 
-// Global ThreadPool
-extern ThreadPool Threadpool;
+    // Deterministic search: thread in turn and threads still searching, in thread order
+    std::mutex turnMutex;
+    std::condition_variable turnCondVar;
+    Thread const *turnThread;
+    std::vector<bool> turnActive;
+
+    // Last nodes read from each thread and their sum, refreshed a few threads at a time
+    std::vector<uint64_t> nodeSamples;
+    uint64_t nodeSampleSum{ 0 };
+    uint16_t nodeSampleIndex{ 0 };
+};
 
 enum OutputState : uint8_t {
     OS_LOCK,
@@ -197,6 +262,10 @@ enum OutputState : uint8_t {
 
 extern std::ostream& operator<<(std::ostream&, OutputState);
 
-#define sync_cout std::cout << OS_LOCK
+// Output is handed to a writer thread which does the actual std::cout (and log file) I/O
+extern AsyncStreamBuffer OutputBuffer;
+extern std::ostream SyncOutput;
+
+#define sync_cout SyncOutput << OS_LOCK
 #define sync_endl std::endl << OS_UNLOCK
 
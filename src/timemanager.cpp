@@ -4,16 +4,29 @@
 #include <cmath>
 
 #include "searcher.h"
+#include "session.h"
 
-TimeManager TimeMgr;
-
-constexpr TimeManager::TimeManager() noexcept :
+TimeManager::TimeManager(Session &s) noexcept :
     remainingNodes{ 0 },
     startTime{ 0 },
+    session{ s },
     optimumTime{ 0 },
     maximumTime{ 0 } {
 }
 
+/// TimeManager::elapsed()
+TimePoint TimeManager::elapsed() const noexcept {
+    return(uint16_t(Options["Time Nodes"]) == 0 ?
+        now() - startTime :
+        session.threadpool.accumulate(&Thread::nodes));
+}
+/// TimeManager::elapsed() with the nodes already known
+TimePoint TimeManager::elapsed(uint64_t nodes) const noexcept {
+    return(uint16_t(Options["Time Nodes"]) == 0 ?
+        now() - startTime :
+        nodes);
+}
+
 /// TimeManager::setup() is called at the beginning of the search and calculates the bounds
 /// of time allowed for the current game ply.  We currently support:
 ///   * x basetime (+ z increment)
@@ -24,24 +37,26 @@ void TimeManager::setup(Color c, int16_t ply) noexcept {
     uint32_t moveSlowness{ Options["Move Slowness"] };
     uint16_t timeNodes{ Options["Time Nodes"] };
 
+    auto &limits{ session.limits };
+
     // When playing in 'Nodes as Time' mode, then convert from time to nodes, and use values in time management.
     // WARNING: Given NodesTime (nodes per milli-seconds) must be much lower then the real engine speed to avoid time losses.
     if (timeNodes != 0) {
         // Only once at after ucinewgame
         if (remainingNodes == 0) {
-            remainingNodes = Limits.clock[c].time * timeNodes;
+            remainingNodes = limits.clock[c].time * timeNodes;
         }
         // Convert from milli-seconds to nodes
-        Limits.clock[c].time = remainingNodes;
-        Limits.clock[c].inc *= timeNodes;
+        limits.clock[c].time = remainingNodes;
+        limits.clock[c].inc *= timeNodes;
     }
     // Maximum move horizon: Plan time management at most this many moves ahead.
-    int32_t maxMovestogo{ Limits.movestogo != 0 ?
-                        std::min(int32_t(Limits.movestogo), 50) : 50 };
+    int32_t maxMovestogo{ limits.movestogo != 0 ?
+                        std::min(int32_t(limits.movestogo), 50) : 50 };
     
     // Make sure timeLeft is > 0 since we may use it as a divisor
-    TimePoint remainTime{ std::max(Limits.clock[c].time
-                                 + Limits.clock[c].inc * (maxMovestogo - 1)
+    TimePoint remainTime{ std::max(limits.clock[c].time
+                                 + limits.clock[c].inc * (maxMovestogo - 1)
                                  - overheadMoveTime    * (maxMovestogo + 2), { 1 }) };
     // A user may scale time usage by setting UCI option "Slow Mover"
     // Default is 100 and changing this value will probably lose ELO.
@@ -54,20 +69,20 @@ void TimeManager::setup(Color c, int16_t ply) noexcept {
     // x basetime (+ z increment)
     // If there is a healthy increment, timeLeft can exceed actual available
     // game time for the current move, so also cap to 20% of available game time.
-    if (Limits.movestogo == 0) {
-        optimumScale = std::min((0.2 * Limits.clock[c].time) / remainTime,
+    if (limits.movestogo == 0) {
+        optimumScale = std::min((0.2 * limits.clock[c].time) / remainTime,
                                 0.008 + std::pow(ply + 3.0, 0.5) / 250.0);
         maximumScale = std::min(4.0 + ply / 12.0, 7.0);
     }
     // x moves in y seconds (+ z increment)
     else {
-        optimumScale = std::min((0.8 * Limits.clock[c].time) / remainTime,
+        optimumScale = std::min((0.8 * limits.clock[c].time) / remainTime,
                                 (0.8 + ply / 128.0) / maxMovestogo);
         maximumScale = std::min(1.5 + 0.11 * maxMovestogo, 6.3);
     }
     // Never use more than 80% of the available time for this move
     optimumTime = TimePoint(optimumScale * remainTime);
-    maximumTime = TimePoint(std::min(maximumScale * optimumTime, 0.8 * Limits.clock[c].time - overheadMoveTime));
+    maximumTime = TimePoint(std::min(maximumScale * optimumTime, 0.8 * limits.clock[c].time - overheadMoveTime));
 
     if (Options["Ponder"]) {
         optimumTime += optimumTime / 4;
@@ -4,13 +4,16 @@
 #include "type.h"
 #include "uci.h"
 
+class Session;
+
 /// The TimeManagement class computes the optimal time to think depending on
 /// the maximum available time, the game move number and other parameters.
 class TimeManager {
 
 public:
 
-    constexpr TimeManager() noexcept;
+    explicit TimeManager(Session&) noexcept;
+    TimeManager() = delete;
     TimeManager(TimeManager const&) = delete;
     TimeManager(TimeManager&&) = delete;
 
@@ -23,12 +26,8 @@ public:
     TimePoint maximum() const noexcept {
         return maximumTime;
     }
-    /// TimeManager::elapsed()
-    TimePoint elapsed() const noexcept {
-        return(uint16_t(Options["Time Nodes"]) == 0 ?
-            now() - startTime :
-            Threadpool.accumulate(&Thread::nodes));
-    }
+    TimePoint elapsed() const noexcept;
+    TimePoint elapsed(uint64_t) const noexcept;
 
     void clear() noexcept {
         remainingNodes = 0;
@@ -41,9 +40,8 @@ public:
 
 private:
 
+    Session &session;
+
     TimePoint optimumTime;
     TimePoint maximumTime;
 };
-
-// Global Time Manager
-extern TimeManager TimeMgr;
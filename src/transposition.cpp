@@ -13,9 +13,6 @@
 #include "helper/string_view.h"
 #include "helper/memoryhandler.h"
 
-TTable TT;
-TTable TTEx;
-
 uint8_t TEntry::Generation{ 0 };
 
 /// TCluster::probe()
@@ -43,7 +40,7 @@ TEntry* TCluster::probe(uint16_t key16, bool &hit) noexcept {
 }
 
 
-constexpr TTable::TTable() noexcept :
+TTable::TTable() noexcept :
     clusterTable{ nullptr },
     clusterCount{ 0 } {
 }
@@ -76,11 +73,10 @@ size_t TTable::resize(size_t memSize) {
     return memSize;
 }
 
-/// TTable::autoResize() set size automatically
+/// TTable::autoResize() set size automatically.
+/// The threads of the session should be idle.
 void TTable::autoResize(size_t memSize) {
 
-    Threadpool.mainThread()->waitIdle();
-
     auto mSize{ memSize != 0 ? memSize : MaxHashSize };
     mSize = std::clamp(mSize, MinHashSize, MaxHashSize);
     while (mSize >= MinHashSize) {
@@ -116,7 +116,7 @@ class TTable final {
 
 public:
 
-    constexpr TTable() noexcept;
+    TTable() noexcept;
     TTable(TTable const&) = delete;
     TTable(TTable&&) = delete;
     ~TTable() noexcept;
@@ -191,7 +191,3 @@ inline TEntry *TTable::probe(Key posiKey, bool &hit) const noexcept {
 
 extern std::ostream& operator<<(std::ostream&, TTable const&);
 extern std::istream& operator>>(std::istream&, TTable&);
-
-// Global Transposition Table
-extern TTable TT;
-extern TTable TTEx;
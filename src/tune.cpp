@@ -33,7 +33,7 @@ string Tune::next(string &names, bool pop) {
     return name;
 }
 
-static void on_tune(UCI::Option const &o) {
+static void on_tune(UCI::Option const &o, Session&) {
 
     if (!Tune::update_on_last || LastOption == &o) {
         Tune::read_options();
@@ -1,11 +1,24 @@
 #include "uci.h"
 
 #include <cassert>
+#include <cctype>
+#include <cmath>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
 #include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "polyglot.h"
 #include "position.h"
@@ -16,12 +29,16 @@
 #include "timemanager.h"
 #include "transposition.h"
 #include "searcher.h"
+#include "searchstats.h"
+#include "session.h"
 #include "skillmanager.h"
 #include "syzygytb.h"
 #include "helper/string.h"
 #include "helper/string_view.h"
 #include "helper/container.h"
 #include "helper/logger.h"
+#include "helper/memoryhandler.h"
+#include "helper/perfcounters.h"
 #include "helper/reporter.h"
 
 using std::string;
@@ -41,6 +58,11 @@ UCI::OptionMap Options;
 
 std::optional<Logger> StdLogger;
 
+// Defined after StdLogger, so destroyed before it: pending output is written while the log is still tied.
+// The writer thread is started and stopped by main(), not by the static initialization and destruction
+AsyncStreamBuffer OutputBuffer{ std::cout };
+std::ostream SyncOutput{ &OutputBuffer };
+
 namespace {
 
     string const Months[12] { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
@@ -253,8 +275,8 @@ namespace UCI {
             && !CaseInsensitiveLessComparer()(v, currentVal);
     }
 
-    /// Option::operator=() updates currentValue and triggers onChange() action
-    Option& Option::operator=(string_view v) {
+    /// Option::set() updates currentValue and triggers onChange() action for the given session
+    Option& Option::set(string_view v, Session &session) {
         assert(!type.empty());
         string val{ v };
         if (type == "check") {
@@ -291,7 +313,7 @@ namespace UCI {
             currentVal = val;
         }
         if (onChange != nullptr) {
-            onChange(*this);
+            onChange(*this, session);
         }
         return *this;
     }
@@ -354,52 +376,69 @@ namespace UCI {
 
     namespace {
 
-        void onHash(Option const &o) noexcept {
-            TT.autoResize(uint32_t(o));
-            TTEx.autoResize(uint32_t(o)/4);
+        void onHash(Option const &o, Session &session) noexcept {
+            session.threadpool.mainThread()->waitIdle();
+            session.tt.autoResize(uint32_t(o));
+            session.ttEx.autoResize(uint32_t(o)/4);
         }
 
-        void onClearHash(Option const&) noexcept {
-            UCI::clear();
+        void onClearHash(Option const&, Session &session) noexcept {
+            session.clear();
         }
 
-        void onSaveHash(Option const&) noexcept {
-            TT.save(Options["Hash File"]);
+        void onSaveHash(Option const&, Session &session) noexcept {
+            session.tt.save(Options["Hash File"]);
         }
-        void onLoadHash(Option const&) noexcept {
-            TT.load(Options["Hash File"]);
+        void onLoadHash(Option const&, Session &session) noexcept {
+            session.tt.load(Options["Hash File"]);
         }
 
-        void onBookFile(Option const &o) noexcept {
+        void onUseBook(Option const &o, Session&) noexcept {
+            Book.inUse = o;
+        }
+        void onBookFile(Option const &o, Session&) noexcept {
             Book.initialize(o);
         }
 
-        void onThreads(Option const&) noexcept {
+        void onThreads(Option const&, Session &session) noexcept {
             auto const threadCount{ optionThreads() };
-            //if (threadCount != Threadpool.size()) {
-            Threadpool.setup(threadCount);
+            //if (threadCount != session.threadpool.size()) {
+            session.threadpool.setup(threadCount);
             //}
         }
 
-        void onTimeNodes(Option const&) noexcept {
-            TimeMgr.clear();
+        void onTimeNodes(Option const&, Session &session) noexcept {
+            session.timeMgr.clear();
         }
 
-        void onLogFile(Option const &o) noexcept {
+        void onLogFile(Option const &o, Session&) noexcept {
+            // Logger swaps the std::cout buffer, so let the writer thread finish first
+            OutputBuffer.drain();
             if (!StdLogger) {
                 StdLogger.emplace(std::cin, std::cout); // Tie std::cin and std::cout to a file.
             }
             StdLogger.value().setup(o);
         }
 
-        void onSyzygyPath(Option const &o) noexcept {
+        void onSyzygyPath(Option const &o, Session&) noexcept {
             SyzygyTB::initialize(o);
         }
 
-        void onUseNNUE(Option const&) noexcept {
+        void onSyzygyLoader(Option const&, Session&) noexcept {
+            SyzygyTB::restartLoader();
+        }
+
+        void onSyzygyProbeCache(Option const &o, Session &session) noexcept {
+            session.threadpool.mainThread()->waitIdle();
+            for (auto *th : session.threadpool) {
+                th->tbCache.resize(o);
+            }
+        }
+
+        void onUseNNUE(Option const&, Session&) noexcept {
             Evaluator::NNUE::initialize();
         }
-        void onEvalFile(Option const&) noexcept {
+        void onEvalFile(Option const&, Session&) noexcept {
             Evaluator::NNUE::initialize();
         }
     }
@@ -415,12 +454,14 @@ namespace UCI {
         Options["Save Hash"]          << Option(onSaveHash);
         Options["Load Hash"]          << Option(onLoadHash);
 
-        Options["Use Book"]           << Option(false);
+        Options["Use Book"]           << Option(false, onUseBook);
         Options["Book File"]          << Option(string("Book.bin"), onBookFile);
         Options["Book Pick Best"]     << Option(true);
         Options["Book Move Num"]      << Option(20, 0, 100);
 
         Options["Threads"]            << Option(1, 0, 512, onThreads);
+        Options["Spin Wait"]          << Option(0, 0, 100000);
+        Options["Deterministic"]      << Option(false);
 
         Options["Skill Level"]        << Option(MaxLevel,  0, MaxLevel);
 
@@ -438,10 +479,15 @@ namespace UCI {
         Options["Ponder"]             << Option(true);
         Options["Time Nodes"]         << Option( 0,  0, 10000, onTimeNodes);
 
+        // Changing these restarts the background loader of the tables found in SyzygyPath
+        Options["SyzygyPremap"]       << Option(false, onSyzygyLoader);
+        Options["SyzygyPreload"]      << Option(string("None var None var WDL var All"), string("None"), onSyzygyLoader);
+        Options["SyzygyLockLimit"]    << Option(0, 0, 1 << 20, onSyzygyLoader);
         Options["SyzygyPath"]         << Option(string(""), onSyzygyPath);
         Options["SyzygyDepthLimit"]   << Option(1, 1, 100);
         Options["SyzygyPieceLimit"]   << Option(SyzygyTB::TBPIECES, 0, SyzygyTB::TBPIECES);
         Options["SyzygyMove50Rule"]   << Option(true);
+        Options["SyzygyProbeCache"]   << Option(256, 0, 1 << 16, onSyzygyProbeCache);
 
         Options["Use NNUE"]           << Option(true, onUseNNUE);
 
@@ -463,10 +509,6 @@ namespace UCI {
 
     namespace {
 
-        /// Forsyth-Edwards Notation (FEN) is a standard notation for describing a particular board position of a chess game.
-        /// The purpose of FEN is to provide all the necessary information to restart a game from a particular position.
-        string const StartFEN{ "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1" };
-
         vector<string> const DefaultFens{
             // ---Chess Normal---
             "setoption name UCI_Chess960 value false",
@@ -540,15 +582,44 @@ namespace UCI {
         void traceEval(Position &pos) {
             StateListPtr states{ new StateList{ 1 } };
             Position cPos;
-            cPos.setup(pos.fen(), states->back(), Threadpool.mainThread());
+            cPos.setup(pos.fen(), states->back(), pos.thread());
+            cPos.accumulators(pos.accumulators());
 
             Evaluator::NNUE::verify();
 
             sync_cout << '\n' << Evaluator::trace(cPos) << sync_endl;
         }
 
+        /// PositionHistory keeps the last "position" command applied to the position of a command thread,
+        /// a following command which only appends moves to it plays just the new ones.
+        struct PositionHistory {
+            string fen;
+            vector<string> moves;
+            Key posiKey{ 0 };
+        };
+        thread_local PositionHistory LastPosition;
+
+        /// setupPosition() sets up the position of the commands of the session.
+        /// It is bound to the main thread but takes its accumulators from the session,
+        /// so playing the moves of a position command never writes into the stack of a searching thread.
+        void setupPosition(Session &session, Position &pos, std::string_view fen, StateInfo &si) {
+            pos.setup(fen, si, session.threadpool.mainThread());
+            pos.accumulators(session.accumulators.data());
+        }
+
+        /// lockShared() locks the data shared by all the sessions (options, tablebases, book, NNUE)
+        /// for a change by the given session. The lock is not taken while another session is searching.
+        std::unique_lock<std::mutex> lockShared(Session const &session) {
+            std::unique_lock<std::mutex> uniqueLock(Session::SharedMutex);
+            if (session.othersSearching()) {
+                uniqueLock.unlock();
+            }
+            return uniqueLock;
+        }
+
         /// setoption() updates the UCI option ("name") to the given value ("value").
-        void setOption(istringstream &iss, Position &pos) {
+        /// Options are shared by all the sessions, so they are not changed while another session is searching.
+        void setOption(Session &session, istringstream &iss, Position &pos) {
             string token;
             iss >> token; // Consume "name" token
 
@@ -568,10 +639,17 @@ namespace UCI {
             }
 
             if (contains(Options, name)) {
-                Options[name] = value;
+                auto const lock{ lockShared(session) };
+                if (!lock.owns_lock()) {
+                    sync_cout << "info string option " << name << " not set, another session is searching" << sync_endl;
+                    return;
+                }
+                // An option may rebuild the threads (and their accumulators) or change the move notation
+                LastPosition = {};
+                Options[name].set(value, session);
                 sync_cout << "info string option " << name << " = " << value << sync_endl;
-                if (pos.thread() != Threadpool.mainThread()) {
-                    pos.thread(Threadpool.mainThread());
+                if (pos.thread() != session.threadpool.mainThread()) {
+                    pos.thread(session.threadpool.mainThread());
                 }
             }
             else { sync_cout << "No such option: \'" << name << "\'" << sync_endl; }
@@ -579,7 +657,8 @@ namespace UCI {
 
         /// position() sets up the starting position ("startpos")/("fen <fenstring>") and then
         /// makes the moves given in the move list ("moves") also saving the moves on stack.
-        void position(istringstream &iss, Position &pos, StateListPtr &states) {
+        /// When the command extends the last one only the new moves are made, on the same stack.
+        void position(Session &session, istringstream &iss, Position &pos, StateListPtr &states) {
             string token;
             iss >> token; // Consume "startpos" or "fen" token
 
@@ -598,46 +677,72 @@ namespace UCI {
             }
             else { return; }
 
-            // Drop old and create a new one
-            states = StateListPtr{ new StateList{ 1 } };
-            pos.setup(fen, states->back(), Threadpool.mainThread());
-            //assert(pos.fen() == toString(trim(fen)));
+            vector<string> moves;
+            while (iss >> token) {
+                moves.push_back(token);
+            }
+
+            auto &last{ LastPosition };
+            bool extend{
+                fen == last.fen
+             && pos.posiKey() == last.posiKey
+             && last.moves.size() <= moves.size()
+             && std::equal(last.moves.begin(), last.moves.end(), moves.begin()) };
+            if (extend
+             && states.get() == nullptr) {
+                // Take back the states handed over to the last search, if it has ended (else all the moves are played again)
+                states = session.threadpool.releaseStates();
+            }
+            extend = extend
+                  && states.get() != nullptr
+                  && &states->back() == pos.state();
+
+            if (!extend) {
+                // Drop old and create a new one
+                states = StateListPtr{ new StateList{ 1 } };
+                setupPosition(session, pos, fen, states->back());
+                //assert(pos.fen() == toString(trim(fen)));
+                last.fen = fen;
+                last.moves.clear();
+            }
 
             // Parse and validate moves (if any)
-            while (iss >> token) {
-                auto const m{ moveOfCAN(token, pos) };
+            for (auto i = last.moves.size(); i < moves.size(); ++i) {
+                auto const m{ moveOfCAN(moves[i], pos) };
                 if (m == MOVE_NONE) {
-                    std::cerr << "ERROR: Illegal Move '" << token << "' at " << iss.tellg() << '\n';
+                    std::cerr << "ERROR: Illegal Move '" << moves[i] << "' at " << i + 1 << '\n';
                     break;
                 }
 
                 states->emplace_back();
                 pos.doMove(m, states->back());
+                last.moves.push_back(moves[i]);
             }
+            last.posiKey = pos.posiKey();
         }
 
         /// go() sets the thinking time and other parameters from the input string, then starts the search.
-        void go(istringstream &iss, Position &pos, StateListPtr &states) {
-            Threadpool.stop = true;
-            Threadpool.mainThread()->waitIdle();
-            Threadpool.mainThread()->ponder = false;
+        void go(Session &session, istringstream &iss, Position &pos, StateListPtr &states) {
+            session.threadpool.stop = true;
+            session.threadpool.mainThread()->waitIdle();
+            session.threadpool.mainThread()->ponder = false;
 
-            Limits.clear();
-            TimeMgr.startTime = now(); // As early as possible!
+            session.limits.clear();
+            session.timeMgr.startTime = now(); // As early as possible!
 
             string token;
             while (iss >> token) {
-                     if (token == "wtime")     { iss >> Limits.clock[WHITE].time; }
-                else if (token == "btime")     { iss >> Limits.clock[BLACK].time; }
-                else if (token == "winc")      { iss >> Limits.clock[WHITE].inc; }
-                else if (token == "binc")      { iss >> Limits.clock[BLACK].inc; }
-                else if (token == "movestogo") { iss >> Limits.movestogo; }
-                else if (token == "movetime")  { iss >> Limits.moveTime; }
-                else if (token == "depth")     { iss >> Limits.depth; }
-                else if (token == "nodes")     { iss >> Limits.nodes; }
-                else if (token == "mate")      { iss >> Limits.mate; }
-                else if (token == "infinite")  { Limits.infinite = true; }
-                else if (token == "ponder")    { Threadpool.mainThread()->ponder = true; }
+                     if (token == "wtime")     { iss >> session.limits.clock[WHITE].time; }
+                else if (token == "btime")     { iss >> session.limits.clock[BLACK].time; }
+                else if (token == "winc")      { iss >> session.limits.clock[WHITE].inc; }
+                else if (token == "binc")      { iss >> session.limits.clock[BLACK].inc; }
+                else if (token == "movestogo") { iss >> session.limits.movestogo; }
+                else if (token == "movetime")  { iss >> session.limits.moveTime; }
+                else if (token == "depth")     { iss >> session.limits.depth; }
+                else if (token == "nodes")     { iss >> session.limits.nodes; }
+                else if (token == "mate")      { iss >> session.limits.mate; }
+                else if (token == "infinite")  { session.limits.infinite = true; }
+                else if (token == "ponder")    { session.threadpool.mainThread()->ponder = true; }
                 // Needs to be the last command on the line
                 else if (token == "searchmoves") {
                     // Parse and Validate search-moves (if any)
@@ -647,13 +752,13 @@ namespace UCI {
                             std::cerr << "ERROR: Illegal Rootmove '" << token << "'\n";
                             continue;
                         }
-                        Limits.searchMoves += m;
+                        session.limits.searchMoves += m;
                     }
                 }
                 else if (token == "ignoremoves") {
                     // Parse and Validate ignore-moves (if any)
                     for (auto const &vm : MoveList<LEGAL>(pos)) {
-                        Limits.searchMoves += vm;
+                        session.limits.searchMoves += vm;
                     }
                     while (iss >> token) {
                         auto const m{ moveOfCAN(token, pos) };
@@ -661,8 +766,8 @@ namespace UCI {
                             std::cerr << "ERROR: Illegal Rootmove '" << token << "'\n";
                             continue;
                         }
-                        if (Limits.searchMoves.contains(m)) {
-                            Limits.searchMoves -= m;
+                        if (session.limits.searchMoves.contains(m)) {
+                            session.limits.searchMoves -= m;
                         }
                     }
                 }
@@ -670,7 +775,9 @@ namespace UCI {
                 //    std::cerr << "Unknown token : " << token << '\n';
                 //}
             }
-            Threadpool.startThinking(pos, states);
+            // Shared data is changed only while no session is searching, so a search starts only under the lock
+            std::lock_guard<std::mutex> lockGuard(Session::SharedMutex);
+            session.threadpool.startThinking(pos, states);
         }
 
         /// setupBench() builds a list of UCI commands to be run by bench.
@@ -692,13 +799,18 @@ namespace UCI {
         ///     * classical (default)
         ///     * nnue
         ///     * mixed
+        /// - Options, in any order, read by bench()
+        ///     * json : write the results as JSON
+        ///     * <runs> : number of runs (default 1, 5 with json)
+        ///     * perf : read the hardware counters
         /// example:
         /// bench -> search default positions up to depth 13
         /// bench 256 4 10 depth default classical -> search default positions up to depth 10 using classical evaluation
         /// bench 64 1 15 -> search default positions up to depth 15 (TT = 64MB)
         /// bench 64 4 5000 movetime current -> search current position with 4 threads for 5 sec (TT = 64MB)
         /// bench 64 1 100000 nodes -> search default positions for 100K nodes (TT = 64MB)
-        /// bench 16 1 5 perft -> run perft 5 on default positions
+        /// bench 16 1 5 perft -> run perft 5 on default positions (movegen throughput in Nodes/second)
+        /// bench 16 1 13 depth default classical json 10 perf -> 10 runs written as JSON, with hardware counters
         vector<string> setupBench(istringstream &iss, Position const &pos) {
             string token;
             // Assign default values to missing arguments
@@ -774,11 +886,206 @@ namespace UCI {
             return uciCmds;
         }
 
-        /// bench() setup list of UCI commands is setup according to bench parameters,
-        /// then it is run one by one printing a summary at the end.
-        void bench(istringstream &isstream, Position &pos, StateListPtr &states) {
+        /// benchWake() measures the thread latencies on the current position with the current threads:
+        /// from "go" until all threads are searching, and from "stop" until the bestmove is decided.
+        /// Searches are silent, a pause (ms) between runs lets idle threads park again when beyond 'Spin Wait'.
+        /// 'bench wake [runs] [pause]'
+        void benchWake(Session &session, istringstream &iss, Position &pos, StateListPtr &states) {
+            uint32_t runs{ 100 };
+            uint32_t pause{ 1 };
+            iss >> runs >> pause;
+            runs = std::max(runs, 1U);
+
+            if (MoveList<LEGAL>(pos).size() == 0) {
+                std::cerr << "ERROR: no legal moves in the current position\n";
+                return;
+            }
+
+            using Micro = std::chrono::duration<double, std::micro>;
+            double goSum{ 0.0 }, goMax{ 0.0 };
+            double stopSum{ 0.0 }, stopMax{ 0.0 };
+
+            session.threadpool.quiet = true;
+            for (uint32_t r = 0; r < runs; ++r) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(pause));
+
+                auto const goStart{ std::chrono::steady_clock::now() };
+                istringstream goIss{ "infinite" };
+                go(session, goIss, pos, states);
+                // A thread is searching once it has counted a node
+                while (std::any_of(session.threadpool.begin(), session.threadpool.end(),
+                                    [](Thread const *th) {
+                                        return th->nodes.load(std::memory_order::memory_order_relaxed) == 0;
+                                    })) {
+                    std::this_thread::yield();
+                }
+                auto const stopStart{ std::chrono::steady_clock::now() };
+                session.threadpool.stop = true;
+                session.threadpool.mainThread()->waitIdle();
+                auto const stopEnd{ std::chrono::steady_clock::now() };
+
+                double const goTime{ Micro(stopStart - goStart).count() };
+                double const stopTime{ Micro(stopEnd - stopStart).count() };
+                goSum   += goTime;
+                goMax    = std::max(goMax, goTime);
+                stopSum += stopTime;
+                stopMax  = std::max(stopMax, stopTime);
+            }
+            session.threadpool.quiet = false;
+
+            ostringstream oss;
+            oss << std::right << std::fixed << std::setprecision(1)
+                << "\n=================================\n"
+                << "Threads         :" << std::setw(16) << session.threadpool.size() << '\n'
+                << "Spin Wait (us)  :" << std::setw(16) << session.threadpool.spinWait.load() << '\n'
+                << "Runs            :" << std::setw(16) << runs << '\n'
+                << "Go avg (us)     :" << std::setw(16) << goSum / runs << '\n'
+                << "Go max (us)     :" << std::setw(16) << goMax << '\n'
+                << "Stop avg (us)   :" << std::setw(16) << stopSum / runs << '\n'
+                << "Stop max (us)   :" << std::setw(16) << stopMax
+                << "\n---------------------------------\n";
+            std::cerr << oss.str() << '\n';
+        }
+
+        /// benchTick() measures the cost of the node count read at every tick of the main thread, with the current threads:
+        /// the sampled read used for 'go nodes' against the walk of all the threads, on idle threads.
+        /// The sampled count lags behind by up to threads/NodeSampleBatch ticks, the nodes searched meanwhile overshoot the limit,
+        /// bench with the nodes limit type reports the overshoot.
+        /// 'bench tick [calls]'
+        void benchTick(Session &session, istringstream &iss) {
+            uint32_t calls{ 1000000 };
+            iss >> calls;
+            calls = std::max(calls, 1U);
+
+            auto &threadpool{ session.threadpool };
+            threadpool.mainThread()->waitIdle();
+
+            using Nano = std::chrono::duration<double, std::nano>;
+            auto const sampleStart{ std::chrono::steady_clock::now() };
+            for (uint32_t c = 0; c < calls; ++c) {
+                threadpool.sampleNodes();
+            }
+            auto const walkStart{ std::chrono::steady_clock::now() };
+            for (uint32_t c = 0; c < calls; ++c) {
+                threadpool.accumulate(&Thread::nodes);
+            }
+            auto const walkEnd{ std::chrono::steady_clock::now() };
+
+            ostringstream oss;
+            oss << std::right << std::fixed << std::setprecision(1)
+                << "\n=================================\n"
+                << "Threads         :" << std::setw(16) << threadpool.size() << '\n'
+                << "Calls           :" << std::setw(16) << calls << '\n'
+                << "Sampled (ns)    :" << std::setw(16) << Nano(walkStart - sampleStart).count() / calls << '\n'
+                << "Walk (ns)       :" << std::setw(16) << Nano(walkEnd - walkStart).count() / calls << '\n'
+                << "Lag max (ticks) :" << std::setw(16) << (threadpool.size() + ThreadPool::NodeSampleBatch - 1) / ThreadPool::NodeSampleBatch
+                << "\n---------------------------------\n";
+            std::cerr << oss.str() << '\n';
+        }
+
+        /// BenchResult keeps the outcome of one bench run
+        struct BenchResult {
+
+            struct Search {
+                string   fen;
+                uint64_t nodes;
+                uint64_t nodesLimit; // Zero without 'go nodes'
+                TimePoint time;
+                Depth    depth;
+                uint32_t hashFull;
+            };
+
+            vector<Search> searches;
+            uint64_t nodes{ 0 };
+            TimePoint elapsed{ 0 };
+
+            // Hardware counters by phase, raw with their times
+            PerfCounters::Counts searchCounters{};
+            PerfCounters::Counts perftCounters{};
+        };
+
+        /// threadCounters(session.threadpool) returns the sum of the hardware counters of the threads.
+        /// The times are summed too, so a sum is scaled by the mean running ratio of the threads.
+        PerfCounters::Counts threadCounters(ThreadPool const &threadpool) noexcept {
+            PerfCounters::Counts counts{};
+            for (auto const *th : threadpool) {
+                auto const thCounts{ th->perfCounters.read() };
+                for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                    counts[e].value   += thCounts[e].value;
+                    counts[e].enabled += thCounts[e].enabled;
+                    counts[e].running += thCounts[e].running;
+                }
+            }
+            return counts;
+        }
+
+        /// nodesOvershoot() returns the mean nodes searched beyond the 'go nodes' limit, none without the limit.
+        std::optional<double> nodesOvershoot(BenchResult const &result) noexcept {
+            double overshoot{ 0.0 };
+            size_t count{ 0 };
+            for (auto const &search : result.searches) {
+                if (search.nodesLimit != 0) {
+                    overshoot += double(std::max(search.nodes, search.nodesLimit) - search.nodesLimit);
+                    ++count;
+                }
+            }
+            if (count == 0) {
+                return std::nullopt;
+            }
+            return overshoot / count;
+        }
+
+        /// addCounters() adds the counts between the two reads, they are scaled only once summed
+        void addCounters(PerfCounters::Counts &counts, PerfCounters::Counts const &end, PerfCounters::Counts const &begin) noexcept {
+            for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                counts[e].value   += end[e].value   - begin[e].value;
+                counts[e].enabled += end[e].enabled - begin[e].enabled;
+                counts[e].running += end[e].running - begin[e].running;
+            }
+        }
+
+        /// Summary is the statistical summary of repeated measurements
+        struct Summary {
+
+            explicit Summary(vector<double> values) noexcept {
+                std::sort(values.begin(), values.end());
+                auto const n{ values.size() };
+                min = values.front();
+                max = values.back();
+                median = n % 2 != 0 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+                mean = std::accumulate(values.begin(), values.end(), 0.0) / n;
+                double sqSum{ 0.0 };
+                for (auto const v : values) {
+                    sqSum += (v - mean) * (v - mean);
+                }
+                stddev = n > 1 ? std::sqrt(sqSum / (n - 1)) : 0.0;
+                // 95% confidence interval of the mean, Student's t for small samples
+                constexpr double T95[]{
+                    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                     2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                     2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+                double const t{ n < 2 ? 0.0 : n - 1 <= std::size(T95) ? T95[n - 2] : 1.960 };
+                ci = t * stddev / std::sqrt(double(n));
+            }
+
+            double mean, median, stddev, ci, min, max;
+        };
+
+        std::ostream& operator<<(std::ostream &ostream, Summary const &summary) {
+            ostream << "{ \"mean\": "   << summary.mean
+                    << ", \"median\": " << summary.median
+                    << ", \"stddev\": " << summary.stddev
+                    << ", \"ci95\": ["  << summary.mean - summary.ci << ", " << summary.mean + summary.ci << "]"
+                    << ", \"min\": "    << summary.min
+                    << ", \"max\": "    << summary.max << " }";
+            return ostream;
+        }
+
+        /// benchRun() runs the bench commands once.
+        /// In quiet mode the searches give no output and positions are not announced.
+        /// The hardware counters of the searches are read from the threads, the ones of perft from the given counters.
+        BenchResult benchRun(Session &session, vector<string> const &uciCmds, Position &pos, StateListPtr &states, bool quiet, PerfCounters const &counters) {
 
-            auto const uciCmds{ setupBench(isstream, pos) };
             auto const cmdCount{ std::count_if(uciCmds.begin(), uciCmds.end(),
                                             [](string const &s) {
                                                 return s.find("eval") == 0
@@ -786,9 +1093,8 @@ namespace UCI {
                                                     || s.find("go ") == 0;
                                             }) };
 
-            Reporter::reset();
+            BenchResult result;
             TimePoint elapsed{ now() };
-            uint64_t nodes{ 0 };
             int32_t i{ 0 };
             for (auto const &cmd : uciCmds) {
                 istringstream iss{ cmd };
@@ -799,8 +1105,10 @@ namespace UCI {
                       || token == "perft"
                       || token == "go") {
 
-                    std::cerr << "\n---------------\nPosition: "
-                              << std::right << std::setw(2) << ++i << '/' << cmdCount << " (" << std::left << pos.fen() << ")\n";
+                    if (!quiet) {
+                        std::cerr << "\n---------------\nPosition: "
+                                  << std::right << std::setw(2) << ++i << '/' << cmdCount << " (" << std::left << pos.fen() << ")\n";
+                    }
 
                          if (token == "eval") {
                         traceEval(pos);
@@ -809,74 +1117,428 @@ namespace UCI {
                         Depth depth{ 1 };
                         iss >> depth; depth = std::max(Depth(1), depth);
 
-                        perft<true>(pos, depth);
+                        auto const begin{ counters.read() };
+                        result.nodes += perft<true>(pos, depth).any;
+                        addCounters(result.perftCounters, counters.read(), begin);
                     }
                     else if (token == "go") {
-                        go(iss, pos, states);
-                        Threadpool.mainThread()->waitIdle();
-                        nodes += Threadpool.accumulate(&Thread::nodes);
+                        auto const startTime{ now() };
+                        auto const begin{ threadCounters(session.threadpool) };
+                        session.threadpool.quiet = quiet;
+                        go(session, iss, pos, states);
+                        session.threadpool.mainThread()->waitIdle();
+                        session.threadpool.quiet = false;
+                        addCounters(result.searchCounters, threadCounters(session.threadpool), begin);
+                        auto const nodes{ session.threadpool.accumulate(&Thread::nodes) };
+                        result.nodes += nodes;
+                        result.searches.push_back({ pos.fen(), nodes, session.limits.nodes, now() - startTime,
+                                                    session.threadpool.mainThread()->finishedDepth, session.tt.hashFull() });
+                        SearchStats::merge(session.threadpool);
+                    }
+                }
+                else if (token == "setoption")  { setOption(session, iss, pos); }
+                else if (token == "position")   { position(session, iss, pos, states); }
+                else if (token == "ucinewgame") {
+                    UCI::clear(session);
+                    elapsed = now();
+                }
+            }
+
+            result.elapsed = std::max(now() - elapsed, { 1 }); // Ensure non-zero to avoid a 'divide by zero'
+            return result;
+        }
+
+        /// meanCounters() returns the mean hardware counters of a phase over the runs, scaled for multiplexing.
+        template<typename Phase>
+        std::array<double, PerfCounters::EVENTS> meanCounters(vector<BenchResult> const &results, Phase phase) {
+            std::array<double, PerfCounters::EVENTS> means{};
+            for (auto const &result : results) {
+                for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                    means[e] += PerfCounters::scaled(phase(result)[e]) / results.size();
+                }
+            }
+            return means;
+        }
+
+        /// runningPercent() returns the lowest share of its enabled time an available event of a phase was counting.
+        /// Below 100 the counters were multiplexed and the counts are estimates.
+        template<typename Phase>
+        double runningPercent(vector<BenchResult> const &results, PerfCounters const &counters, Phase phase) {
+            double percent{ 100.0 };
+            for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                if (!counters.available(PerfCounters::Event(e))) {
+                    continue;
+                }
+                uint64_t enabled{ 0 }, running{ 0 };
+                for (auto const &result : results) {
+                    enabled += phase(result)[e].enabled;
+                    running += phase(result)[e].running;
+                }
+                if (enabled != 0) {
+                    percent = std::min(100.0 * running / enabled, percent);
+                }
+            }
+            return percent;
+        }
+
+        /// benchCounters() writes a table of the mean hardware counters by phase.
+        void benchCounters(std::ostream &ostream, vector<BenchResult> const &results, PerfCounters const &counters) {
+            bool available{ false };
+            for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                available |= counters.available(PerfCounters::Event(e));
+            }
+            if (!available) {
+                ostream << "Hardware counters unavailable (perf_event_open refused)\n";
+                return;
+            }
+
+            auto const searchPhase{ [](BenchResult const &r) { return r.searchCounters; } };
+            auto const perftPhase{ [](BenchResult const &r) { return r.perftCounters; } };
+            auto const search{ meanCounters(results, searchPhase) };
+            auto const perft{ meanCounters(results, perftPhase) };
+
+            ostringstream oss;
+            oss << std::right << std::fixed << std::setprecision(0)
+                << std::setw(16) << "Counter" << std::setw(18) << "search" << std::setw(18) << "perft" << '\n';
+            for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                oss << std::setw(16) << PerfCounters::Names[e];
+                if (counters.available(PerfCounters::Event(e))) {
+                    oss << std::setw(18) << search[e] << std::setw(18) << perft[e] << '\n';
+                }
+                else {
+                    oss << std::setw(18) << "n/a" << std::setw(18) << "n/a" << '\n';
+                }
+            }
+            auto const ipc{ [](auto const &values) {
+                return values[PerfCounters::CYCLES] != 0 ? values[PerfCounters::INSTRUCTIONS] / values[PerfCounters::CYCLES] : 0.0;
+            } };
+            auto const searchRunning{ runningPercent(results, counters, searchPhase) };
+            auto const perftRunning{ runningPercent(results, counters, perftPhase) };
+            oss << std::setprecision(2)
+                << std::setw(16) << "IPC" << std::setw(18) << ipc(search) << std::setw(18) << ipc(perft) << '\n'
+                << std::setw(16) << "Running %" << std::setw(18) << searchRunning << std::setw(18) << perftRunning << '\n';
+            if (std::min(searchRunning, perftRunning) < 100.0) {
+                oss << "Counters multiplexed, the counts are scaled estimates\n";
+            }
+            ostream << oss.str();
+        }
+
+        /// benchCountersJSON() writes the mean hardware counters by phase as a JSON object, null when unavailable.
+        /// "running" is the percent of the time the counters were counting, below 100 they were multiplexed.
+        void benchCountersJSON(std::ostream &ostream, vector<BenchResult> const &results, PerfCounters const &counters) {
+            auto const phase{ [&](auto counts) {
+                auto const means{ meanCounters(results, counts) };
+                ostringstream oss;
+                oss << std::fixed << std::setprecision(0) << "{ ";
+                for (uint8_t e = 0; e < PerfCounters::EVENTS; ++e) {
+                    oss << (e == 0 ? "\"" : ", \"") << PerfCounters::Names[e] << "\": ";
+                    if (counters.available(PerfCounters::Event(e))) {
+                        oss << means[e];
+                    }
+                    else {
+                        oss << "null";
+                    }
+                }
+                oss << std::setprecision(2) << ", \"running\": " << runningPercent(results, counters, counts) << " }";
+                return oss.str();
+            } };
+
+            ostream << "{ \"search\": " << phase([](BenchResult const &r) { return r.searchCounters; })
+                    << ", \"perft\": "  << phase([](BenchResult const &r) { return r.perftCounters; })
+                    << " }";
+        }
+
+        /// benchJSON() writes the results of the bench runs as a JSON object:
+        /// the totals and every search summarized over the runs.
+        void benchJSON(std::ostream &ostream, ThreadPool const &threadpool, vector<BenchResult> const &results, PerfCounters const &counters) {
+
+            auto const summary{ [&](auto value) {
+                vector<double> values;
+                for (auto const &result : results) {
+                    values.push_back(value(result));
+                }
+                return Summary{ values };
+            } };
+
+            bool const stable{ std::all_of(results.begin(), results.end(),
+                                            [&](BenchResult const &result) {
+                                                return result.nodes == results.front().nodes;
+                                            }) };
+
+            ostringstream oss;
+            oss << std::fixed << std::setprecision(2)
+                << "{\n"
+                << "  \"runs\": "        << results.size() << ",\n"
+                << "  \"threads\": "     << threadpool.size() << ",\n"
+                << "  \"nodes\": "       << results.front().nodes << ",\n"
+                << "  \"nodesStable\": " << std::boolalpha << stable << ",\n";
+            if (auto const overshoot{ nodesOvershoot(results.front()) }) {
+                oss << "  \"nodesOvershoot\": " << *overshoot << ",\n";
+            }
+            oss << "  \"time\": "  << summary([](BenchResult const &r) { return double(r.elapsed); }) << ",\n"
+                << "  \"nps\": "   << summary([](BenchResult const &r) { return 1000.0 * r.nodes / r.elapsed; }) << ",\n"
+                << "  \"searches\": [";
+            for (size_t i = 0; i < results.front().searches.size(); ++i) {
+                auto const &search{ results.front().searches[i] };
+                oss << (i == 0 ? "\n" : ",\n")
+                    << "    { \"fen\": \""    << search.fen << "\""
+                    << ", \"nodes\": "     << search.nodes
+                    << ", \"depth\": "     << search.depth
+                    << ", \"hashfull\": "  << search.hashFull
+                    << ",\n      \"time\": " << summary([&](BenchResult const &r) { return double(r.searches[i].time); })
+                    << ",\n      \"nps\": "  << summary([&](BenchResult const &r) { return 1000.0 * r.searches[i].nodes / std::max(r.searches[i].time, { 1 }); })
+                    << " }";
+            }
+            oss << " ]";
+            if (counters.opened()) {
+                oss << ",\n  \"counters\": ";
+                benchCountersJSON(oss, results, counters);
+            }
+            if (!SearchStats::empty()) {
+                oss << ",\n  \"searchStats\": ";
+                SearchStats::printJSON(oss);
+            }
+            oss << "\n}";
+            ostream << oss.str();
+        }
+
+        /// bench() setup list of UCI commands is setup according to bench parameters,
+        /// then it is run one by one printing a summary at the end.
+        /// With 'json [runs]' after the bench parameters the commands are run silently the given times (default 5)
+        /// and the results are also written as JSON, with the mean, median, stddev and 95% confidence interval.
+        /// The summary goes to the standard error, the JSON alone to the standard output so that it can be parsed as is.
+        /// 'bench wake ...' measures the thread latencies instead, see benchWake(),
+        /// 'bench tick ...' the cost of the node count checks, see benchTick().
+        void bench(Session &session, istringstream &isstream, Position &pos, StateListPtr &states) {
+
+            auto const start{ isstream.tellg() };
+            string mode;
+            if (isstream >> mode) {
+                mode = toLower(mode);
+                if (mode == "wake") {
+                    benchWake(session, isstream, pos, states);
+                    return;
+                }
+                if (mode == "tick") {
+                    benchTick(session, isstream);
+                    return;
+                }
+            }
+            isstream.clear();
+            isstream.seekg(start);
+
+            auto const uciCmds{ setupBench(isstream, pos) };
+            bool json{ false };
+            bool perf{ false };
+            uint32_t runs{ 0 };
+            string option;
+            while (isstream >> option) {
+                option = toLower(option);
+                     if (option == "json") { json = true; }
+                else if (option == "perf") { perf = true; }
+                else if (std::isdigit(static_cast<unsigned char>(option[0]))) {
+                    // Out of range count is ignored, leaving the default
+                    uint32_t count;
+                    if (istringstream{ option } >> count) {
+                        runs = count;
                     }
                 }
-                else if (token == "setoption")  { setOption(iss, pos); }
-                else if (token == "position")   { position(iss, pos, states); }
-                else if (token == "ucinewgame") { UCI::clear(); elapsed = now(); }
             }
+            if (runs == 0) {
+                runs = json ? 5 : 1;
+            }
+
+            // Counters of this thread and the perft threads it starts, the search threads open their own
+            PerfCounters counters;
+            if (perf) {
+                counters.open();
+            }
+            session.threadpool.hardwareCounters = perf;
 
-            elapsed = std::max(now() - elapsed, { 1 }); // Ensure non-zero to avoid a 'divide by zero'
+            // Statistics cover all the runs, drop the ones of the earlier searches
+            SearchStats::merge(session.threadpool);
+            SearchStats::reset();
+            Reporter::reset();
+            vector<BenchResult> results;
+            for (uint32_t r = 0; r < runs; ++r) {
+                results.push_back(benchRun(session, uciCmds, pos, states, json, counters));
+            }
+            session.threadpool.hardwareCounters = false;
 
             Reporter::print(); // Just before exiting
 
+            // Same nodes on every run of a reproducible bench, time is the mean
+            TimePoint elapsed{ 0 };
+            for (auto const &result : results) {
+                elapsed += result.elapsed;
+            }
+            elapsed = std::max(elapsed / TimePoint(runs), { 1 });
+            auto const nodes{ results.front().nodes };
+
             ostringstream oss;
             oss << std::right
                 << "\n=================================\n"
                 << "Total time (ms) :" << std::setw(16) << elapsed << '\n'
                 << "Nodes searched  :" << std::setw(16) << nodes << '\n'
-                << "Nodes/second    :" << std::setw(16) << nodes * 1000 / elapsed
-                << "\n---------------------------------\n";
+                << "Nodes/second    :" << std::setw(16) << nodes * 1000 / elapsed;
+            if (auto const overshoot{ nodesOvershoot(results.front()) }) {
+                oss << '\n'
+                    << "Nodes overshoot :" << std::setw(16) << uint64_t(*overshoot);
+            }
+            oss << "\n---------------------------------\n";
             std::cerr << oss.str() << '\n';
+
+            if (perf) {
+                benchCounters(std::cerr, results, counters);
+                std::cerr << '\n';
+            }
+            if (json) {
+                ostringstream jsonOss;
+                benchJSON(jsonOss, session.threadpool, results, counters);
+                sync_cout << jsonOss.str() << sync_endl;
+            }
+            else
+            if (!SearchStats::empty()) {
+                SearchStats::print(std::cerr);
+                std::cerr << '\n';
+            }
         }
-    }
 
-    /// handleCommands() waits for a command from stdin, parses it and calls the appropriate function.
-    /// Also intercepts EOF from stdin to ensure gracefully exiting if the GUI dies unexpectedly.
-    /// Single command line arguments is executed once and returns immediately, e.g. 'bench'.
-    /// In addition to the UCI ones, also some additional commands are supported.
-    void handleCommands(int argc, char const *const argv[]) {
+        /// analyse() searches every position of an EPD file with a fixed depth or nodes limit.
+        /// Each thread runs its own single-threaded session with its own hash, limits and position,
+        /// pulling the positions from a shared index and writing a result line as soon as it is done.
+        /// 'analyse <epd-file> depth|nodes <n> [threads]'
+        void analyse(Session &session, istringstream &iss) {
+            string epdFile, limit;
+            uint64_t value{ 0 };
+            uint16_t threadCount{ optionThreads() };
+            iss >> epdFile >> limit >> value >> threadCount;
+            limit = toLower(limit);
+
+            if ((limit != "depth"
+              && limit != "nodes")
+             || value == 0) {
+                sync_cout << "Usage: analyse <epd-file> depth|nodes <n> [threads]" << sync_endl;
+                return;
+            }
 
-        Position pos;
-        // Stack to keep track of the position states along the setup moves
-        // (from the start position to the position just before the search starts).
-        // Needed by 'draw by repetition' detection.
-        StateListPtr states{ new StateList{ 1 } };
-        pos.setup(StartFEN, states->back(), Threadpool.mainThread());
+            vector<string> fens;
+            std::ifstream ifstream{ epdFile, std::ios::in };
+            if (!ifstream.is_open()) {
+                std::cerr << "ERROR: unable to open file ... \'" << epdFile << "\'\n";
+                return;
+            }
+            string line;
+            while (std::getline(ifstream, line, '\n')) {
+                // EPD has the first four FEN fields, followed by either the move counters or the operations
+                istringstream epd{ line };
+                string fen, field;
+                for (int i = 0; i < 6 && (epd >> field); ++i) {
+                    if (i >= 4
+                     && field.find_first_not_of("0123456789") != string::npos) {
+                        break;
+                    }
+                    fen += (i != 0 ? " " : "") + field;
+                }
+                if (!whiteSpaces(fen)
+                 && fen[0] != '#') {
+                    fens.push_back(fen);
+                }
+            }
+            ifstream.close();
 
-        // Join arguments
-        string cmd;
-        for (int i = 1; i < argc; ++i) {
-            cmd += string(argv[i]) + " ";
-        }
+            threadCount = uint16_t(std::clamp(size_t(threadCount), size_t(1), std::max(fens.size(), size_t(1))));
+            uint32_t const hash{ std::max(uint32_t(Options["Hash"]) / threadCount, uint32_t(TTable::MinHashSize)) };
 
-        Reporter::reset();
-        string token;
-        do {
-            // Block here waiting for input or EOF
-            if (argc == 1
-                // Default endline '\n'
-             && !std::getline(std::cin, cmd)) {
-                cmd = "quit";
+            session.threadpool.mainThread()->waitIdle();
+            Evaluator::NNUE::verify();
+
+            auto const startTime{ now() };
+            std::atomic<size_t> fenIndex{ 0 };
+            std::atomic<uint64_t> totalNodes{ 0 };
+
+            vector<std::thread> threads;
+            for (uint16_t index = 0; index < threadCount; ++index) {
+                threads.emplace_back(
+                    [&, threadCount, index]() {
+
+                        if (threadCount > 8) {
+                            WinProcGroup::bind(index);
+                        }
+                        Session workerSession{ session.id };
+                        CurrentSession = &workerSession;
+                        auto &threadpool{ workerSession.threadpool };
+                        threadpool.quiet = true;
+                        threadpool.setup(1, hash);
+
+                        size_t i;
+                        while ((i = fenIndex.fetch_add(1, std::memory_order::memory_order_relaxed)) < fens.size()) {
+                            Position pos;
+                            StateListPtr states{ new StateList{ 1 } };
+                            setupPosition(workerSession, pos, fens[i], states->back());
+
+                            workerSession.limits.clear();
+                            if (limit == "depth") {
+                                workerSession.limits.depth = Depth(std::min(value, uint64_t(MAX_PLY - 1)));
+                            }
+                            else {
+                                workerSession.limits.nodes = value;
+                            }
+
+                            {
+                                std::lock_guard<std::mutex> lockGuard(Session::SharedMutex);
+                                threadpool.startThinking(pos, states);
+                            }
+                            threadpool.mainThread()->waitIdle();
+
+                            auto const *th{ threadpool.mainThread() };
+                            auto const &rm{ th->rootMoves[0] };
+                            auto v{ rm[0] == MOVE_NONE ?
+                                        th->rootPos.checkers() != 0 ? -VALUE_MATE : VALUE_DRAW :
+                                        rm.newValue };
+                            if (threadpool.tbHasRoot
+                             && std::abs(v) < +VALUE_MATE_1_MAX_PLY) {
+                                v = rm.tbValue;
+                            }
+                            auto const nodes{ threadpool.accumulate(&Thread::nodes) };
+                            totalNodes += nodes;
+
+                            sync_cout << "analyse "     << i + 1
+                                      << " depth "      << th->finishedDepth
+                                      << " score "      << v
+                                      << " nodes "      << nodes
+                                      << " bestmove "   << rm[0]
+                                      << " fen "        << fens[i] << sync_endl;
+                        }
+                        threadpool.setup(0);
+                    });
             }
+            for (auto &th : threads) {
+                th.join();
+            }
+
+            auto const elapsed{ std::max(now() - startTime, { 1 }) };
+            sync_cout << "info string Analysed " << fens.size() << " positions with " << threadCount << " threads"
+                      << " in " << elapsed << " ms"
+                      << " (" << fens.size() * 1000 / elapsed << " positions/second, "
+                      << totalNodes * 1000 / elapsed << " nodes/second)" << sync_endl;
+        }
+
+        /// execute() parses a command and calls the appropriate function.
+        /// Returns false on 'quit'.
+        bool execute(Session &session, string const &cmd, Position &pos, StateListPtr &states) {
 
             istringstream iss{ cmd };
-            token.clear(); // Avoid a stale if getline() returns empty or blank line
+            string token;
             iss >> std::skipws >> token;
             token = toLower(token);
 
                  if (token == "quit"
-                  || token == "stop")       { Threadpool.stop = true; }
+                  || token == "stop")       { session.threadpool.stop = true; }
             // GUI sends 'ponderhit' to tell that the opponent has played the expected move.
             // So 'ponderhit' will be sent if told to ponder on the same move the opponent has played.
             // Now should continue searching but switch from pondering to normal search.
-            else if (token == "ponderhit")  { Threadpool.mainThread()->ponder = false; } // Switch to normal search
+            else if (token == "ponderhit")  { session.threadpool.mainThread()->ponder = false; } // Switch to normal search
             else if (token == "isready")    { sync_cout << "readyok" << sync_endl; }
             else if (token == "uci")        {
                 sync_cout << "id name "     << Name << " " << engineInfo() << '\n'
@@ -884,13 +1546,14 @@ namespace UCI {
                           << Options
                           << "uciok" << sync_endl;
             }
-            else if (token == "ucinewgame") { UCI::clear(); }
-            else if (token == "position")   { position(iss, pos, states); }
-            else if (token == "go")         { go(iss, pos, states); }
-            else if (token == "setoption")  { setOption(iss, pos); }
+            else if (token == "ucinewgame") { UCI::clear(session); }
+            else if (token == "position")   { position(session, iss, pos, states); }
+            else if (token == "go")         { go(session, iss, pos, states); }
+            else if (token == "setoption")  { setOption(session, iss, pos); }
             // Additional custom non-UCI commands, useful for debugging
             // Do not use these commands during a search!
-            else if (token == "bench")      { bench(iss, pos, states); }
+            else if (token == "bench")      { bench(session, iss, pos, states); }
+            else if (token == "analyse")    { analyse(session, iss); }
             else if (token == "flip")       { pos.flip(); }
             else if (token == "mirror")     { pos.mirror(); }
             else if (token == "compiler")   { sync_cout << compilerInfo() << sync_endl; }
@@ -904,6 +1567,25 @@ namespace UCI {
 
                 perft<true>(pos, depth, detail);
             }
+            else if (token == "bookbench")  {
+                uint32_t probeCount{ 1000000 };
+                iss >> probeCount;
+                sync_cout << Book.benchmark(std::max(probeCount, 1U)) << sync_endl;
+            }
+            else if (token == "makebook")   {
+                string pgnFile, bookFile;
+                int16_t maxPly{ 30 };
+                uint32_t minGames{ 3 };
+                iss >> pgnFile >> bookFile >> maxPly >> minGames;
+                // The book may be the one in use, so it is replaced only while no other session is searching
+                auto const lock{ lockShared(session) };
+                if (!lock.owns_lock()) {
+                    sync_cout << "info string makebook refused, another session is searching" << sync_endl;
+                }
+                else {
+                    makeBook(session.threadpool, pgnFile, bookFile, maxPly, minGames);
+                }
+            }
             else if (token == "keys")       {
                 ostringstream oss;
                 oss << "FEN: " << pos.fen() << '\n'
@@ -916,86 +1598,220 @@ namespace UCI {
             }
             else if (token == "moves")      {
                 sync_cout;
+                MoveList<LEGAL> const legalMoves{ pos };
                 int32_t moveCount;
-                std::cout << '\n';
+                SyncOutput << '\n';
                 if (pos.checkers() == 0) {
-                    std::cout << "Capture moves: ";
+                    SyncOutput << "Capture moves: ";
                     moveCount = 0;
                     for (auto const &vm : MoveList<CAPTURE>(pos)) {
-                        if (pos.pseudoLegal(vm)
-                         && pos.legal(vm)) {
-                            std::cout << moveToSAN(vm, pos) << " ";
+                        if (legalMoves.contains(vm)) {
+                            SyncOutput << moveToSAN(vm, pos) << " ";
                             ++moveCount;
                         }
                     }
-                    std::cout << "(" << moveCount << ")\n";
+                    SyncOutput << "(" << moveCount << ")\n";
 
-                    std::cout << "Quiet moves: ";
+                    SyncOutput << "Quiet moves: ";
                     moveCount = 0;
                     for (auto const &vm : MoveList<QUIET>(pos)) {
-                        if (pos.pseudoLegal(vm)
-                         && pos.legal(vm)) {
-                            std::cout << moveToSAN(vm, pos) << " ";
+                        if (legalMoves.contains(vm)) {
+                            SyncOutput << moveToSAN(vm, pos) << " ";
                             ++moveCount;
                         }
                     }
-                    std::cout << "(" << moveCount << ")\n";
+                    SyncOutput << "(" << moveCount << ")\n";
 
-                    std::cout << "Quiet Check moves: ";
+                    SyncOutput << "Quiet Check moves: ";
                     moveCount = 0;
                     for (auto const &vm : MoveList<QUIET_CHECK>(pos)) {
-                        if (pos.pseudoLegal(vm)
-                         && pos.legal(vm)) {
-                            std::cout << moveToSAN(vm, pos) << " ";
+                        if (legalMoves.contains(vm)) {
+                            SyncOutput << moveToSAN(vm, pos) << " ";
                             ++moveCount;
                         }
                     }
-                    std::cout << "(" << moveCount << ")\n";
+                    SyncOutput << "(" << moveCount << ")\n";
 
-                    std::cout << "Natural moves: ";
+                    SyncOutput << "Natural moves: ";
                     moveCount = 0;
                     for (auto const &vm : MoveList<NORMAL>(pos)) {
-                        if (pos.pseudoLegal(vm)
-                         && pos.legal(vm)) {
-                            std::cout << moveToSAN(vm, pos) << " ";
+                        if (legalMoves.contains(vm)) {
+                            SyncOutput << moveToSAN(vm, pos) << " ";
                             ++moveCount;
                         }
                     }
-                    std::cout << "(" << moveCount << ")\n";
+                    SyncOutput << "(" << moveCount << ")\n";
                 }
                 else {
-                    std::cout << "Evasion moves: ";
+                    SyncOutput << "Evasion moves: ";
                     moveCount = 0;
                     for (auto const &vm : MoveList<EVASION>(pos)) {
-                        if (pos.pseudoLegal(vm)
-                         && pos.legal(vm)) {
-                            std::cout << moveToSAN(vm, pos) << " ";
+                        if (legalMoves.contains(vm)) {
+                            SyncOutput << moveToSAN(vm, pos) << " ";
                             ++moveCount;
                         }
                     }
-                    std::cout << "(" << moveCount << ")\n";
+                    SyncOutput << "(" << moveCount << ")\n";
+                }
+                SyncOutput << "Legal moves: ";
+                for (auto const &vm : legalMoves) {
+                    SyncOutput << moveToSAN(vm, pos) << " ";
                 }
-                std::cout << sync_endl;
+                SyncOutput << "(" << legalMoves.size() << ")\n";
+                SyncOutput << sync_endl;
             }
             else {
                 sync_cout << "Unknown command: \'" << cmd << "\'" << sync_endl;
             }
 
-        } while (argc == 1
-              && token != "quit");
+            return token != "quit";
+        }
+
+        /// SessionRunner runs a session of the multi-session driver on its own command thread.
+        /// The commands forwarded to it are executed in order, exactly as the front end does,
+        /// but on the threads, hash and limits of the session.
+        class SessionRunner final {
+
+        public:
+
+            explicit SessionRunner(uint32_t id) :
+                session{ id },
+                thread{ &SessionRunner::threadFunc, this } {
+            }
+            ~SessionRunner() {
+                post("quit");
+                thread.join();
+            }
+
+            SessionRunner(SessionRunner const&) = delete;
+            SessionRunner& operator=(SessionRunner const&) = delete;
+
+            void post(string const &cmd) {
+                {
+                    std::lock_guard<std::mutex> lockGuard(mutex);
+                    commands.push_back(cmd);
+                }
+                conditionVar.notify_one();
+            }
+
+        private:
+
+            void threadFunc() {
+                CurrentSession = &session;
+                session.threadpool.setup(optionThreads());
+
+                Position pos;
+                StateListPtr states{ new StateList{ 1 } };
+                setupPosition(session, pos, StartFEN, states->back());
+                UCI::clear(session);
+
+                string cmd;
+                do {
+                    std::unique_lock<std::mutex> uniqueLock(mutex);
+                    conditionVar.wait(uniqueLock, [&]{ return !commands.empty(); });
+                    cmd = commands.front();
+                    commands.pop_front();
+                    uniqueLock.unlock();
+                } while (execute(session, cmd, pos, states));
+
+                session.threadpool.setup(0);
+            }
+
+            Session session;
+            std::deque<string> commands;
+            std::mutex mutex;
+            std::condition_variable conditionVar;
+            std::thread thread;
+        };
+
+        std::map<uint32_t, std::unique_ptr<SessionRunner>> Sessions;
+
+        /// session() forwards a command to a session of the multi-session driver,
+        /// the session is started on its first command and ended by 'quit'.
+        /// 'session <id> <command>'
+        void session(istringstream &iss) {
+            uint32_t id{ 0 };
+            iss >> id;
+            if (id == 0) {
+                sync_cout << "Invalid session id" << sync_endl;
+                return;
+            }
+            string cmd;
+            std::getline(iss >> std::ws, cmd);
+
+            string token;
+            istringstream{ cmd } >> token;
+            if (toLower(token) == "quit") {
+                Sessions.erase(id);
+                return;
+            }
+
+            auto &runner{ Sessions[id] };
+            if (!runner) {
+                runner.reset(new SessionRunner(id));
+            }
+            runner->post(cmd);
+        }
     }
 
-    /// clear() clear all stuff
-    void clear() noexcept {
-        Threadpool.stop = true;
-        Threadpool.mainThread()->waitIdle();
+    /// handleCommands() waits for a command from stdin, parses it and calls the appropriate function.
+    /// Also intercepts EOF from stdin to ensure gracefully exiting if the GUI dies unexpectedly.
+    /// Single command line arguments is executed once and returns immediately, e.g. 'bench'.
+    /// In addition to the UCI ones, also some additional commands are supported.
+    void handleCommands(int argc, char const *const argv[]) {
 
-        TT.clear();
-        TTEx.clear();
-        TimeMgr.clear();
-        Threadpool.clean();
+        Position pos;
+        // Stack to keep track of the position states along the setup moves
+        // (from the start position to the position just before the search starts).
+        // Needed by 'draw by repetition' detection.
+        StateListPtr states{ new StateList{ 1 } };
+        setupPosition(MainSession, pos, StartFEN, states->back());
+
+        // Join arguments
+        string cmd;
+        for (int i = 1; i < argc; ++i) {
+            cmd += string(argv[i]) + " ";
+        }
 
-        SyzygyTB::initialize(Options["SyzygyPath"]); // Free up mapped files
+        Reporter::reset();
+        bool running{ true };
+        do {
+            // Block here waiting for input or EOF
+            if (argc == 1
+                // Default endline '\n'
+             && !std::getline(std::cin, cmd)) {
+                cmd = "quit";
+            }
+
+            istringstream iss{ cmd };
+            string token;
+            iss >> std::skipws >> token;
+            // Multi-session driver commands are only taken from the front end
+            if (toLower(token) == "session") {
+                session(iss);
+            }
+            else {
+                running = execute(MainSession, cmd, pos, states);
+            }
+        } while (argc == 1
+              && running);
+
+        // End all the sessions
+        Sessions.clear();
+    }
+
+    /// clear() clear all stuff of the session
+    void clear(Session &session) noexcept {
+        session.clear();
+
+        // Mapped files are shared, so free them up only while no other session may probe.
+        // Premapped or preloaded tables are kept warm across the games.
+        auto const lock{ lockShared(session) };
+        if (lock.owns_lock()
+         && !Options["SyzygyPremap"]
+         && Options["SyzygyPreload"] == "None") {
+            SyzygyTB::initialize(Options["SyzygyPath"]); // Free up mapped files
+        }
     }
 
 }
@@ -8,6 +8,8 @@
 #include "type.h"
 #include "helper/comparer.h"
 
+class Session;
+
 extern std::string const Name;
 extern std::string const Version;
 extern std::string const Author;
@@ -23,7 +25,7 @@ namespace UCI {
 
     public:
 
-        using OnChange = void(*)(Option const&);
+        using OnChange = void(*)(Option const&, Session&);
 
         Option(OnChange = nullptr);
         Option(bool, OnChange = nullptr);
@@ -46,7 +48,7 @@ namespace UCI {
 
         bool operator==(std::string_view) const;
 
-        Option& operator=(std::string_view);
+        Option& set(std::string_view, Session&);
 
         void operator<<(Option const&);
 
@@ -78,7 +80,7 @@ namespace UCI {
 
     extern void handleCommands(int, char const *const[]);
 
-    extern void clear() noexcept;
+    extern void clear(Session&) noexcept;
 }
 
 // Global nocase mapping of Options
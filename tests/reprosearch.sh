@@ -14,14 +14,20 @@ echo "reprosearch testing started"
 # repeat two short games, separated by ucinewgame.
 # with go nodes $nodes they should result in exactly
 # the same node count for each iteration.
+# with more threads the search is made deterministic.
 cat << EOF > reprosearch.exp
  set timeout 10
  spawn ./DON
- lassign \$argv nodes
+ lassign \$argv nodes threads
 
  send "uci\n"
  expect "uciok"
 
+ if {\$threads > 1} {
+   send "setoption name Threads value \$threads\n"
+   send "setoption name Deterministic value true\n"
+ }
+
  send "ucinewgame\n"
  send "position startpos\n"
  send "go nodes \$nodes\n"
@@ -46,16 +52,21 @@ EOF
 
 # to increase the likelyhood of finding a non-reproducible case,
 # the allowed number of nodes are varied systematically
+for threads in 1 4
+do
 for i in `seq 1 20`
 do
 
     nodes=$((100*3**i/2**i))
-    echo "reprosearch testing with $nodes nodes"
+    echo "reprosearch testing with $nodes nodes and $threads threads"
 
+    # the output writer may coalesce intermediate info lines,
+    # so only the last info line before each bestmove is compared.
     # each line should appear exactly an even number of times
-    expect reprosearch.exp $nodes 2>&1 | grep -o "nodes [0-9]*" | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
+    expect reprosearch.exp $nodes $threads 2>&1 | tr -d '\r' | awk '/^info .* nodes / { last = $0 } /^bestmove/ { print last, $0 }' | sed 's/ time [0-9]* nps [0-9]*//' | sort | uniq -c | awk '{if ($1%2!=0) exit(1)}'
 
 done
+done
 
 rm reprosearch.exp
 